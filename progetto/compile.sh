@@ -1,5 +1,14 @@
 #!/usr/bin/env bash
 
 #gcc -Wall -Werror -std=gnu11 -O0 -g3 -fsanitize=address  -lm main.c -o main
+# sharded build, one worker thread per group of highways:
+#gcc -Wall -Werror -std=gnu11 -O2 -DHIGHWAY_SHARDS=4 main.c -o main -lm -lpthread
+# range partitioned build, one worker thread per distance range of a highway:
+#gcc -Wall -Werror -std=gnu11 -O2 -DRANGE_PARTITIONS=4 main.c -o main -lm -lpthread
+# compact station store for highways with millions of stations:
+#gcc -Wall -Werror -std=gnu11 -O2 -DCOMPACT_STATIONS main.c -o main -lm
+# hardware counters of the route searches, printed on stderr at exit:
+#gcc -Wall -Werror -std=gnu11 -O2 -DPERF_COUNTERS main.c -o main -lm
+# 64 bit distances and 32 bit vehicle counts, for very long highways:
+#gcc -Wall -Werror -std=gnu11 -O2 -DWIDE_HIGHWAY main.c -o main -lm
 gcc -Wall -Werror -std=gnu11 -O0 -g3  -lm main.c -o main
-
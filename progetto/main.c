@@ -1,6 +1,80 @@
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(HIGHWAY_SHARDS) && defined(RANGE_PARTITIONS)
+#error "HIGHWAY_SHARDS and RANGE_PARTITIONS cannot be used together"
+#endif
+
+#if defined(COMPACT_STATIONS) && defined(RANGE_PARTITIONS)
+#error "COMPACT_STATIONS and RANGE_PARTITIONS cannot be used together"
+#endif
+
+// number of worker threads of the threaded builds
+#if defined(HIGHWAY_SHARDS)
+#define WORKER_THREADS HIGHWAY_SHARDS
+#elif defined(RANGE_PARTITIONS)
+#define WORKER_THREADS RANGE_PARTITIONS
+#endif
+
+#ifdef WORKER_THREADS
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
+
+#if defined(WORKER_THREADS) || defined(COMPACT_STATIONS)
+#include <string.h>
+#endif
+
+// compiling with -DPERF_COUNTERS counts cycles, instructions, branch, cache
+// and TLB misses of the forward and backward searches, printed on stderr
+// at exit, or why the counters are not available
+#ifdef PERF_COUNTERS
+#include "../sorting/perfcount.h"
+
+struct perfRegion_t forward_search_counters = PERF_REGION("forward BFS");
+struct perfRegion_t backward_search_counters = PERF_REGION("backward BFS");
+
+__attribute__((destructor)) void print_search_counters(void) {
+  perfPrint(&forward_search_counters, stderr);
+  perfPrint(&backward_search_counters, stderr);
+}
+
+#define PERF_BEGIN(sample)                                                     \
+  struct perfSample_t sample;                                                  \
+  perfBegin(&sample)
+#define PERF_END(region, sample) perfEnd(&region, &sample)
+#else
+#define PERF_BEGIN(sample)
+#define PERF_END(region, sample)
+#endif
+
+/*
+Compiling with -DWIDE_HIGHWAY distances and autonomies are 64 bits, and the
+vehicles with the same autonomy in a station are counted on 32 bits, for
+highways longer than 4294967295 km or with more than 65535 equal vehicles
+in a station. By default they are 32 and 16 bits, which keeps the nodes
+smaller: a station_t takes 72 bytes instead of 88, a vehicle_t 24 instead
+of 32 and a node of the BFS array 20 instead of 32. A station that already
+has VEHICLE_COUNT_MAX vehicles of an autonomy does not get more, instead of
+wrapping the counter.
+ */
+#ifdef WIDE_HIGHWAY
+typedef unsigned long long distance_t;
+typedef unsigned int vehicle_count_t;
+#define DISTANCE_MAX ULLONG_MAX
+#define VEHICLE_COUNT_MAX UINT_MAX
+#define DISTANCE_FORMAT "%llu"
+#else
+typedef unsigned int distance_t;
+typedef unsigned short int vehicle_count_t;
+#define DISTANCE_MAX UINT_MAX
+#define VEHICLE_COUNT_MAX USHRT_MAX
+#define DISTANCE_FORMAT "%u"
+#endif
+
 // helper definition to select maximum between two variables
 #define MAX(X, Y) (X > Y ? X : Y)
 
@@ -37,9 +111,9 @@ The operations of our interest for vehicles are:
  */
 struct vehicle_t {
   // key
-  unsigned int autonomy;
+  distance_t autonomy;
   // number of vehicle with same autonomy
-  unsigned short int num;
+  vehicle_count_t num;
   // height of node, used to calculate balance vector
   unsigned short int height;
 
@@ -69,7 +143,7 @@ The operations of our interest for vehicles are:
  */
 struct station_t {
   // key
-  unsigned int distance;
+  distance_t distance;
   // height of node, used to calculate balance vector
   unsigned int height;
   // pointers to parent, left and right child
@@ -80,13 +154,13 @@ struct station_t {
   // this is the root of an AVL tree for vehicles
   struct vehicle_t *vehicle_parking;
   // max vehicle autonomy among vehicles in vehicle_parking
-  unsigned int max_vehicle_autonomy;
+  distance_t max_vehicle_autonomy;
   /*
     theoretical reachable stations on the left and right,
     based on distance and max_vehicle_autonomy
    */
-  unsigned int leftmost_reachable_station;
-  unsigned int rightmost_reachable_station;
+  distance_t leftmost_reachable_station;
+  distance_t rightmost_reachable_station;
 
   struct station_t *next; // used for breadth-first search
   struct station_t *prev; // used for breadth-first search
@@ -95,9 +169,9 @@ struct station_t {
 // Used for BFS
 struct station_graph_node_t {
   // these fields are copied from the stations
-  unsigned int distance;
-  unsigned int leftmost_reachable_station;
-  unsigned int rightmost_reachable_station;
+  distance_t distance;
+  distance_t leftmost_reachable_station;
+  distance_t rightmost_reachable_station;
 
   enum color_t color; // used for breadth-first search
 
@@ -198,7 +272,7 @@ struct station_queue_t *enqueue_station(struct station_queue_t *queue,
 }
 
 // Create a new node with given autonomy
-struct vehicle_t *create_vehicle_node(unsigned int autonomy) {
+struct vehicle_t *create_vehicle_node(distance_t autonomy) {
   struct vehicle_t *res;
 
   res = malloc(sizeof(struct vehicle_t));
@@ -257,8 +331,9 @@ struct vehicle_t *right_rotate_vehicle(struct vehicle_t *vehicle) {
 }
 
 // Add vehicle with given autonomy to specified tree.
-struct vehicle_t *add_vehicle(struct vehicle_t *vehicle,
-                              unsigned int autonomy) {
+// The flag is set to 0 if the counter of the autonomy is full
+struct vehicle_t *add_vehicle(struct vehicle_t *vehicle, distance_t autonomy,
+                              char *flag) {
   // if we reach the bottom of the tree without finding
   // a node with the key we add the new node here
   if (vehicle == NULL)
@@ -266,15 +341,18 @@ struct vehicle_t *add_vehicle(struct vehicle_t *vehicle,
 
   // if we find the key we increment the counter
   if (autonomy == vehicle->autonomy) {
-    vehicle->num++;
+    if (vehicle->num == VEHICLE_COUNT_MAX)
+      *flag = 0;
+    else
+      vehicle->num++;
     return vehicle;
   }
 
   // if the key is different we try to add the vehicle on the correct side
   if (autonomy < vehicle->autonomy) {
-    vehicle->left = add_vehicle(vehicle->left, autonomy);
+    vehicle->left = add_vehicle(vehicle->left, autonomy, flag);
   } else {
-    vehicle->right = add_vehicle(vehicle->right, autonomy);
+    vehicle->right = add_vehicle(vehicle->right, autonomy, flag);
   }
 
   // we have to recalculate the height of current node
@@ -339,7 +417,7 @@ struct vehicle_t *maximum_vehicle(struct vehicle_t *vehicle) {
 // the flag is 0 if not removed, 1 if removed but still present and 2 if removed
 // completely
 struct vehicle_t *remove_vehicle(struct vehicle_t *vehicle,
-                                 unsigned int autonomy, char *flag) {
+                                 distance_t autonomy, char *flag) {
 
   // If the vehicle with given autonomy is not found, do nothing
   if (vehicle == NULL)
@@ -436,7 +514,7 @@ void remove_all_vehicles(struct vehicle_t *vehicle) {
 }
 
 struct vehicle_t *find_vehicle(struct vehicle_t *vehicle,
-                               unsigned int autonomy) {
+                               distance_t autonomy) {
 
   // if we reach the end we return NULL
   if (vehicle == NULL)
@@ -515,7 +593,7 @@ struct station_t *successor_station(struct station_t *station) {
 }
 
 /* struct station_t* station_greater_or_equal_to_distance(struct station_t*
-station_tree, unsigned int distance) { if (station_tree == NULL) return NULL;
+station_tree, distance_t distance) { if (station_tree == NULL) return NULL;
 
     struct station_t* tmp,
                     * res;
@@ -537,23 +615,31 @@ station_tree, unsigned int distance) { if (station_tree == NULL) return NULL;
     return res;
 } */
 
+// reachable distances from a station, clamped to 0 and DISTANCE_MAX so that
+// they do not wrap around at the ends of the range
+distance_t leftmost_reachable(distance_t distance, distance_t autonomy) {
+  return autonomy > distance ? 0 : distance - autonomy;
+}
+
+distance_t rightmost_reachable(distance_t distance, distance_t autonomy) {
+  return autonomy > DISTANCE_MAX - distance ? DISTANCE_MAX
+                                            : distance + autonomy;
+}
+
 // function used to calculate leftmost and rightmost reachable stations
 // when we update max_vehicle_autonomy
 void update_reachable_stations(struct station_t *station) {
 
   station->rightmost_reachable_station =
-      station->distance + station->max_vehicle_autonomy;
-  if (station->max_vehicle_autonomy > station->distance)
-    station->leftmost_reachable_station = 0;
-  else
-    station->leftmost_reachable_station =
-        station->distance - station->max_vehicle_autonomy;
+      rightmost_reachable(station->distance, station->max_vehicle_autonomy);
+  station->leftmost_reachable_station =
+      leftmost_reachable(station->distance, station->max_vehicle_autonomy);
 
   return;
 }
 
 // Create a new node with given distance
-struct station_t *create_station_node(unsigned int distance) {
+struct station_t *create_station_node(distance_t distance) {
   struct station_t *res;
 
   res = malloc(sizeof(struct station_t));
@@ -625,7 +711,7 @@ struct station_t *right_rotate_station(struct station_t *station) {
 }
 
 // Add station with given distance to specified tree.
-struct station_t *add_station(struct station_t *station, unsigned int distance,
+struct station_t *add_station(struct station_t *station, distance_t distance,
                               struct station_t **station_ref) {
   // if we reach the bottom of the tree without finding
   // a node with the key we add the new node here
@@ -685,7 +771,7 @@ struct station_t *add_station(struct station_t *station, unsigned int distance,
 }
 
 struct station_t *remove_station(struct station_t *station,
-                                 unsigned int distance, char *flag) {
+                                 distance_t distance, char *flag) {
 
   // If the station with given distance is not found, do nothing
   if (station == NULL)
@@ -801,7 +887,7 @@ void remove_all_stations(struct station_t *station) {
 }
 
 struct station_t *find_station(struct station_t *station,
-                               unsigned int distance) {
+                               distance_t distance) {
 
   // if we reach the end we return NULL
   if (station == NULL)
@@ -820,20 +906,24 @@ struct station_t *find_station(struct station_t *station,
   return NULL;
 }
 
-void add_vehicle_to_station(struct station_t *station, unsigned int autonomy) {
+// returns 0 if the station is full of vehicles with given autonomy
+char add_vehicle_to_station(struct station_t *station, distance_t autonomy) {
 
-  station->vehicle_parking = add_vehicle(station->vehicle_parking, autonomy);
+  char flag;
+  flag = 1;
+  station->vehicle_parking =
+      add_vehicle(station->vehicle_parking, autonomy, &flag);
   // check if we need to update max vehicle height
   if (autonomy > station->max_vehicle_autonomy) {
     station->max_vehicle_autonomy = autonomy;
     update_reachable_stations(station);
   }
 
-  return;
+  return flag;
 }
 
 void remove_vehicle_from_station(struct station_t *station,
-                                 unsigned int autonomy) {
+                                 distance_t autonomy) {
 
   char flag;
   flag = 0;
@@ -857,37 +947,38 @@ void remove_vehicle_from_station(struct station_t *station,
 
 // We can use the stack to print the correct order of stations
 void print_route(struct station_graph_node_t *vect, unsigned int station,
-                 unsigned int end_station) {
+                 unsigned int end_station, FILE *out) {
 
   if (vect[station].prev_on_path == -1) {
-    printf("%d\n", vect[station].distance);
+    fprintf(out, DISTANCE_FORMAT "\n", vect[station].distance);
     return;
   }
 
-  printf("%d ", vect[station].distance);
+  fprintf(out, DISTANCE_FORMAT " ", vect[station].distance);
 
-  print_route(vect, vect[station].prev_on_path, end_station);
+  print_route(vect, vect[station].prev_on_path, end_station, out);
 
   return;
 }
 
 // We can use the stack to print the correct order of stations
 void print_route_reverse(struct station_graph_node_t *vect,
-                         unsigned int station, unsigned int end_station) {
+                         unsigned int station, unsigned int end_station,
+                         FILE *out) {
 
   if (vect[station].prev_on_path == -1) {
-    printf("%d ", vect[station].distance);
+    fprintf(out, DISTANCE_FORMAT " ", vect[station].distance);
     return;
   }
 
-  print_route_reverse(vect, vect[station].prev_on_path, end_station);
+  print_route_reverse(vect, vect[station].prev_on_path, end_station, out);
 
   if (station == end_station) {
-    printf("%d\n", vect[station].distance);
+    fprintf(out, DISTANCE_FORMAT "\n", vect[station].distance);
     return;
   }
 
-  printf("%d ", vect[station].distance);
+  fprintf(out, DISTANCE_FORMAT " ", vect[station].distance);
   return;
 }
 
@@ -940,21 +1031,110 @@ void vector_of_stations_between(struct station_graph_node_t *vect,
 // the same number of stations we have to select the one with the first
 // different station with the lower distance. All edges are calculated at
 // runtime using distance of stations and leftmost and rightmost reachable
-// stations.
-void plan_route(struct station_t *station_tree, struct station_t *begin_station,
-                struct station_t *end_station, struct station_queue_t **queue) {
+// stations. The two searches work on the array of the stations between begin
+// and end, and print the route on the given stream.
 
-  unsigned int num_stations; // number of stations between begin and end station
+// forward case, the begin station is the first of the array and the end
+// station is the last one
+void search_route_forward(struct station_graph_node_t *station_vector,
+                          unsigned int num_stations,
+                          struct station_queue_t **queue, FILE *out) {
+
+  unsigned int curr, tmp, end;
+
+  PERF_BEGIN(sample);
+
+  *queue = create_station_queue(INIT_STATION_QUEUE_DIM);
+
+  end = num_stations - 1;
+
+  station_vector[0].color = GREY;
+  *queue = enqueue_station(*queue, 0);
+  tmp = 1;
+  while (!is_empty_station_queue(*queue)) {
+    curr = dequeue_station(*queue);
+
+    while (tmp < num_stations &&
+           station_vector[tmp].distance <=
+               station_vector[curr].rightmost_reachable_station) {
+      if (tmp == end) {
+        station_vector[tmp].prev_on_path = curr;
+        *queue = deallocate_station_queue(*queue);
+        PERF_END(forward_search_counters, sample);
+        print_route_reverse(station_vector, tmp, end, out);
+        return;
+      }
+      station_vector[tmp].prev_on_path = curr;
+      *queue = enqueue_station(*queue, tmp);
+
+      tmp = tmp + 1;
+    }
+  }
+
+  *queue = deallocate_station_queue(*queue);
+  PERF_END(forward_search_counters, sample);
+  fprintf(out, "nessun percorso\n");
+  return;
+}
 
-  unsigned int curr, tmp, begin, end;
+// backward case, the end station is the first of the array and the begin
+// station is the last one
+void search_route_backward(struct station_graph_node_t *station_vector,
+                           unsigned int num_stations,
+                           struct station_queue_t **queue, FILE *out) {
+
+  unsigned int curr, tmp, begin;
+
+  PERF_BEGIN(sample);
 
   *queue = create_station_queue(INIT_STATION_QUEUE_DIM);
 
+  begin = num_stations - 1;
+
+  station_vector[0].color = GREY;
+  *queue = enqueue_station(*queue, 0);
+
+  while (!is_empty_station_queue(*queue)) {
+    curr = dequeue_station(*queue);
+    tmp = curr + 1;
+    while (tmp != num_stations) {
+      if (station_vector[curr].distance <
+          station_vector[tmp].leftmost_reachable_station) {
+        tmp = tmp + 1;
+        continue;
+      }
+      if (tmp == begin) {
+        station_vector[tmp].prev_on_path = curr;
+        *queue = deallocate_station_queue(*queue);
+        PERF_END(backward_search_counters, sample);
+        print_route(station_vector, tmp, begin, out);
+        return;
+      }
+      if (station_vector[tmp].color == WHITE) {
+        station_vector[tmp].color = GREY;
+        station_vector[tmp].prev_on_path = curr;
+        *queue = enqueue_station(*queue, tmp);
+      }
+      tmp = tmp + 1;
+    }
+  }
+
+  *queue = deallocate_station_queue(*queue);
+  PERF_END(backward_search_counters, sample);
+  fprintf(out, "nessun percorso\n");
+  return;
+}
+
+void plan_route(struct station_t *station_tree, struct station_t *begin_station,
+                struct station_t *end_station, struct station_queue_t **queue,
+                FILE *out) {
+
+  unsigned int num_stations; // number of stations between begin and end station
+
   // if the start and end stations are the same print the distance and return
   if (begin_station->distance == end_station->distance) {
 
-    printf("%d\n", begin_station->distance);
-    *queue = deallocate_station_queue(*queue);
+    fprintf(out, DISTANCE_FORMAT "\n", begin_station->distance);
     return;
   }
 
@@ -965,29 +1145,7 @@ void plan_route(struct station_t *station_tree, struct station_t *begin_station,
     struct station_graph_node_t station_vector[num_stations];
     vector_of_stations_between(station_vector, begin_station, end_station);
 
-    end = num_stations - 1;
-
-    station_vector[0].color = GREY;
-    *queue = enqueue_station(*queue, 0);
-    tmp = 1;
-    while (!is_empty_station_queue(*queue)) {
-      curr = dequeue_station(*queue);
-
-      while (tmp < num_stations &&
-             station_vector[tmp].distance <=
-                 station_vector[curr].rightmost_reachable_station) {
-        if (tmp == end) {
-          station_vector[tmp].prev_on_path = curr;
-          print_route_reverse(station_vector, tmp, end);
-          *queue = deallocate_station_queue(*queue);
-          return;
-        }
-        station_vector[tmp].prev_on_path = curr;
-        *queue = enqueue_station(*queue, tmp);
-
-        tmp = tmp + 1;
-      }
-    }
+    search_route_forward(station_vector, num_stations, queue, out);
   }
   // backward case
   else {
@@ -996,177 +1154,2041 @@ void plan_route(struct station_t *station_tree, struct station_t *begin_station,
     struct station_graph_node_t station_vector[num_stations];
     vector_of_stations_between(station_vector, end_station, begin_station);
 
-    begin = num_stations - 1;
+    search_route_backward(station_vector, num_stations, queue, out);
+  }
+
+  return;
+}
+
+#ifdef COMPACT_STATIONS
+/*
+Compact station store: compiling with -DCOMPACT_STATIONS the stations of a
+highway are not AVL tree nodes anymore, but are kept sorted in blocks of
+at most STATION_BLOCK_DIM stations. A station_t takes 64 bytes, plus the
+allocator overhead, mostly spent on six pointers; in a block a station
+takes its max_vehicle_autonomy and the offset of its distance from the
+first distance of the block, frame of reference encoded in 16 bits when
+the block spans less than 65536 km, in 32 bits when it spans less than
+4294967296 km and in 64 bits otherwise, which only happens with
+WIDE_HIGHWAY. Only the stations with vehicles have a vehicle_parking
+pointer, in an array of their own marked by a bitmap in the block, so a
+station without vehicles takes about 9 bytes instead of 76. Leftmost and
+rightmost reachable stations are computed from distance and
+max_vehicle_autonomy when needed.
+A directory keeps the first distance of every block in a sorted array, so
+finding a station is a binary search on the directory and a scan of the
+offsets of one block, and building the array for plan_route decodes only
+the blocks between begin and end.
+Every change to a block decodes its distances, and its vehicle_parking if
+stations move, changes them and encodes them back, so the encoding is
+always the tightest one.
+ */
 
-    station_vector[0].color = GREY;
-    *queue = enqueue_station(*queue, 0);
+#define STATION_BLOCK_DIM 64
+
+struct station_block_t {
+  distance_t min; // distance of the first station
+  distance_t max; // distance of the last station
+  unsigned short count;
+  unsigned char offset_bytes; // 2, 4 or 8
+  unsigned long long parked;  // bit i set if station i has vehicles
+  // the vehicles of the stations with a bit in parked, in order
+  struct vehicle_t **vehicle_parking;
+  distance_t max_vehicle_autonomy[STATION_BLOCK_DIM];
+  // STATION_BLOCK_DIM offsets from min, the first count are used
+  unsigned char offsets[];
+};
 
-    while (!is_empty_station_queue(*queue)) {
-      curr = dequeue_station(*queue);
-      tmp = curr + 1;
-      while (tmp != num_stations) {
-        if (station_vector[curr].distance <
-            station_vector[tmp].leftmost_reachable_station) {
-          tmp = tmp + 1;
-          continue;
-        }
-        if (tmp == begin) {
-          station_vector[tmp].prev_on_path = curr;
-          print_route(station_vector, tmp, begin);
-          *queue = deallocate_station_queue(*queue);
-          return;
-        }
-        if (station_vector[tmp].color == WHITE) {
-          station_vector[tmp].color = GREY;
-          station_vector[tmp].prev_on_path = curr;
-          *queue = enqueue_station(*queue, tmp);
-        }
-        tmp = tmp + 1;
-      }
-    }
+struct station_store_t {
+  distance_t *block_min; // copy of the min of every block, for searching
+  struct station_block_t **block;
+  unsigned int blocks;
+  unsigned int dim;
+};
+
+// a station in the store, valid until stations are added or removed
+struct station_ref_t {
+  unsigned int block;
+  unsigned int idx;
+};
+
+void decode_station_block(struct station_block_t *block,
+                          distance_t *distances) {
+
+  // separate loops so that the compiler can vectorize all of them
+  if (block->offset_bytes == 2) {
+    unsigned short *offsets = (unsigned short *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      distances[i] = block->min + offsets[i];
+  } else if (block->offset_bytes == 4) {
+    unsigned int *offsets = (unsigned int *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      distances[i] = block->min + offsets[i];
+  } else {
+    unsigned long long *offsets = (unsigned long long *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      distances[i] = block->min + offsets[i];
   }
 
-  printf("nessun percorso\n");
-  *queue = deallocate_station_queue(*queue);
   return;
 }
 
-int main(void) {
+// encodes block->count sorted distances in the block, which must not be
+// NULL and is reallocated if the offsets need a different size
+struct station_block_t *encode_station_block(struct station_block_t *block,
+                                             distance_t *distances) {
 
-  char command[19], flag;
-  unsigned int station_distance, end_station_distance, vehicle_autonomy,
-      vehicles_number;
+  unsigned char offset_bytes;
+  distance_t span;
 
-  struct station_t *stations = NULL;    // Empty tree for stations
-  struct station_t *station;            // the station on which we do operations
-  struct station_queue_t *queue = NULL; // Pointer to queue
+  span = distances[block->count - 1] - distances[0];
+  offset_bytes = span > 0xFFFFFFFFu ? 8 : span > 0xFFFF ? 4 : 2;
+  if (block->offset_bytes != offset_bytes) {
+    block = realloc(block, sizeof(struct station_block_t) +
+                               STATION_BLOCK_DIM * offset_bytes);
+    block->offset_bytes = offset_bytes;
+  }
 
-  // Scan every command until EOF or Ctrl-D in terminal
-  while (scanf("%s %d", command, &station_distance) != EOF) {
-    /*
-     * To avoid the use of strcmp, we can simply check
-     * letter in position number 12 of the captured string,
-     * which is different for every command:
-     * aggiungi-stazione  -> z
-     * demolisci-stazione -> a
-     * aggiungi-auto      -> o
-     * rottama-auto       -> \0 null character
-     * pianifica-percorso -> r
-     */
-    switch (command[12]) {
-    // aggiungi-stazione
-    case 'z':
-      // We check that the station does not already exist
-      station = NULL;
-      stations = add_station(stations, station_distance, &station);
-      stations->parent = NULL;
-      if (station != NULL) {
-
-        // fix next prev pointers
-        struct station_t *tmp;
-        tmp = predecessor_station(station);
-        if (tmp != NULL) {
-          station->prev = tmp;
-          station->next = tmp->next;
-          tmp->next = station;
-          if (station->next != NULL)
-            station->next->prev = station;
-        } else {
-          tmp = successor_station(station);
-          station->next = tmp;
-          if (tmp != NULL)
-            tmp->prev = station;
-        }
+  block->min = distances[0];
+  block->max = distances[block->count - 1];
+
+  if (offset_bytes == 2) {
+    unsigned short *offsets = (unsigned short *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      offsets[i] = distances[i] - block->min;
+  } else if (offset_bytes == 4) {
+    unsigned int *offsets = (unsigned int *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      offsets[i] = distances[i] - block->min;
+  } else {
+    unsigned long long *offsets = (unsigned long long *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      offsets[i] = distances[i] - block->min;
+  }
 
-        if (scanf("%d", &vehicles_number) == 1) {
-          for (int i = 0; i < vehicles_number; i++) {
-            if (scanf("%d", &vehicle_autonomy) == 1) {
-              add_vehicle_to_station(station, vehicle_autonomy);
-            }
-          }
-        }
+  return block;
+}
 
-        printf("aggiunta\n");
-      } else {
-        if (scanf("%d", &vehicles_number) == 1) {
-          for (int i = 0; i < vehicles_number; i++) {
-            if (scanf("%d", &vehicle_autonomy) == 1) {
-            }
-          }
-          printf("non aggiunta\n");
-        }
-      }
+// the vehicles of every station of the block, NULL for the ones without
+void decode_station_parking(struct station_block_t *block,
+                            struct vehicle_t **parking) {
 
-      break;
-    // demolisci-stazione
-    case 'a':
-      // Try to remove station with given distance.
-      // If all goes well find_station() returns pointer to station,
-      // else returns NULL
-      flag = 0;
-      stations = remove_station(stations, station_distance, &flag);
-      if (stations != NULL)
-        stations->parent = NULL;
-      if (flag == 1) {
-
-        printf("demolita\n");
-      } else {
-        printf("non demolita\n");
-      }
-      break;
-    // aggiungi-auto
-    case 'o':
-      // Check if station with given distance exists.
-      // If exists find_station returns pointer to station,
-      // else NULL
-      if (scanf("%d", &vehicle_autonomy) == 1) {
-        station = find_station(stations, station_distance);
-        if (station != NULL) {
-          add_vehicle_to_station(station, vehicle_autonomy);
-          printf("aggiunta\n");
-        } else {
-          printf("non aggiunta\n");
-        }
-      }
-      break;
-    // rottama-auto
-    case '\0':
-      // Check if the station exists then check
-      // if the car has been removed or not
-      if (scanf("%d", &vehicle_autonomy) == 1) {
-        station = find_station(stations, station_distance);
-        if (station != NULL) {
-          if (find_vehicle(station->vehicle_parking, vehicle_autonomy) !=
-              NULL) {
-            remove_vehicle_from_station(station, vehicle_autonomy);
-            printf("rottamata\n");
-          } else {
-            printf("non rottamata\n");
-          }
-        } else {
-          printf("non rottamata\n");
-        }
-      }
-      break;
-    // pianifica-percorso
-    case 'r':
-      if (scanf("%d", &end_station_distance) == 1) {
-        struct station_t *begin_station;
-        struct station_t *end_station;
-        begin_station = find_station(stations, station_distance);
-        end_station = find_station(stations, end_station_distance);
-        if (begin_station != NULL && end_station != NULL)
-          plan_route(stations, begin_station, end_station, &queue);
-        else
-          printf("nessun percorso\n");
-      }
-      break;
+  unsigned int n = 0;
+
+  for (unsigned int i = 0; i < block->count; i++)
+    parking[i] = block->parked >> i & 1 ? block->vehicle_parking[n++] : NULL;
+
+  return;
+}
+
+// slots allocated for n vehicle trees, a power of 2 so that adding stations
+// with vehicles one at a time reallocates only log(n) times
+unsigned int station_parking_dim(unsigned int n) {
+
+  return n <= 1 ? n : 1U << (32 - __builtin_clz(n - 1));
+}
+
+// makes room for n vehicle trees in the block, which has room for old
+void resize_station_parking(struct station_block_t *block, unsigned int old,
+                            unsigned int n) {
+
+  if (n == 0) {
+    free(block->vehicle_parking);
+    block->vehicle_parking = NULL;
+  } else if (station_parking_dim(n) != station_parking_dim(old))
+    block->vehicle_parking = realloc(block->vehicle_parking,
+                                     sizeof(struct vehicle_t *) *
+                                         station_parking_dim(n));
+
+  return;
+}
+
+// keeps the vehicles of the stations of the block that have any, parking
+// is overwritten
+void encode_station_parking(struct station_block_t *block,
+                            struct vehicle_t **parking) {
+
+  unsigned int n = 0, old = __builtin_popcountll(block->parked);
+
+  block->parked = 0;
+  for (unsigned int i = 0; i < block->count; i++) {
+    if (parking[i] != NULL) {
+      block->parked |= 1ULL << i;
+      parking[n++] = parking[i];
     }
   }
 
-  remove_all_stations(stations);
+  resize_station_parking(block, old, n);
+  if (n > 0)
+    memcpy(block->vehicle_parking, parking, sizeof(struct vehicle_t *) * n);
+
+  return;
+}
 
-  stations = NULL;
+// gives station idx of the block, which has no vehicles, its first ones, or
+// takes its vehicles away if vehicles is NULL
+void set_station_parking(struct station_block_t *block, unsigned int idx,
+                         struct vehicle_t *vehicles) {
+
+  unsigned int n = __builtin_popcountll(block->parked);
+  unsigned int rank =
+      __builtin_popcountll(block->parked & ((1ULL << idx) - 1));
+
+  if (vehicles != NULL) {
+    resize_station_parking(block, n, n + 1);
+    memmove(&block->vehicle_parking[rank + 1], &block->vehicle_parking[rank],
+            sizeof(struct vehicle_t *) * (n - rank));
+    block->vehicle_parking[rank] = vehicles;
+    block->parked |= 1ULL << idx;
+  } else {
+    memmove(&block->vehicle_parking[rank], &block->vehicle_parking[rank + 1],
+            sizeof(struct vehicle_t *) * (n - rank - 1));
+    block->parked &= ~(1ULL << idx);
+    resize_station_parking(block, n, n - 1);
+  }
 
-  return 0;
+  return;
+}
+
+// the vehicles of station idx of the block, NULL if it has none
+struct vehicle_t **station_block_parking(struct station_block_t *block,
+                                         unsigned int idx) {
+
+  if (!(block->parked >> idx & 1))
+    return NULL;
+
+  return &block->vehicle_parking[__builtin_popcountll(
+      block->parked & ((1ULL << idx) - 1))];
+}
+
+// number of stations in the block with distance lower than the given one,
+// counted without branches over all the offsets
+unsigned int station_block_position(struct station_block_t *block,
+                                    distance_t distance) {
+
+  unsigned int res = 0;
+  distance_t target;
+
+  if (distance <= block->min)
+    return 0;
+  if (distance > block->max)
+    return block->count;
+
+  target = distance - block->min;
+  if (block->offset_bytes == 2) {
+    unsigned short *offsets = (unsigned short *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      res += offsets[i] < target;
+  } else if (block->offset_bytes == 4) {
+    unsigned int *offsets = (unsigned int *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      res += offsets[i] < target;
+  } else {
+    unsigned long long *offsets = (unsigned long long *)block->offsets;
+    for (unsigned int i = 0; i < block->count; i++)
+      res += offsets[i] < target;
+  }
+
+  return res;
+}
+
+distance_t station_block_distance(struct station_block_t *block,
+                                  unsigned int idx) {
+
+  if (block->offset_bytes == 2)
+    return block->min + ((unsigned short *)block->offsets)[idx];
+  if (block->offset_bytes == 4)
+    return block->min + ((unsigned int *)block->offsets)[idx];
+
+  return block->min + ((unsigned long long *)block->offsets)[idx];
+}
+
+void init_station_store(struct station_store_t *store) {
+
+  store->blocks = 0;
+  store->dim = 0;
+  store->block_min = NULL;
+  store->block = NULL;
+
+  return;
+}
+
+void remove_station_store(struct station_store_t *store) {
+
+  for (unsigned int b = 0; b < store->blocks; b++) {
+    for (int i = 0; i < __builtin_popcountll(store->block[b]->parked); i++)
+      remove_all_vehicles(store->block[b]->vehicle_parking[i]);
+    free(store->block[b]->vehicle_parking);
+    free(store->block[b]);
+  }
+
+  free(store->block_min);
+  free(store->block);
+  init_station_store(store);
+
+  return;
+}
+
+// the block that holds, or would hold, a distance: the last one whose min is
+// not greater than the distance, or the first one
+unsigned int station_store_block(struct station_store_t *store,
+                                 distance_t distance) {
+
+  unsigned int low = 0, high = store->blocks;
+
+  while (high - low > 1) {
+    unsigned int mid = low + (high - low) / 2;
+    if (store->block_min[mid] <= distance)
+      low = mid;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+// returns 1 and the station with given distance if it exists, 0 otherwise
+char find_stored_station(struct station_store_t *store, distance_t distance,
+                         struct station_ref_t *ref) {
+
+  if (store->blocks == 0)
+    return 0;
+
+  ref->block = station_store_block(store, distance);
+  ref->idx = station_block_position(store->block[ref->block], distance);
+
+  return ref->idx < store->block[ref->block]->count &&
+         station_block_distance(store->block[ref->block], ref->idx) ==
+             distance;
+}
+
+// makes room in the directory for a block in position b
+void insert_store_block(struct station_store_t *store, unsigned int b,
+                        struct station_block_t *block) {
+
+  if (store->blocks == store->dim) {
+    store->dim = store->dim == 0 ? 8 : store->dim << 1;
+    store->block_min =
+        realloc(store->block_min, sizeof(distance_t) * store->dim);
+    store->block =
+        realloc(store->block, sizeof(struct station_block_t *) * store->dim);
+  }
+
+  memmove(&store->block_min[b + 1], &store->block_min[b],
+          sizeof(distance_t) * (store->blocks - b));
+  memmove(&store->block[b + 1], &store->block[b],
+          sizeof(struct station_block_t *) * (store->blocks - b));
+  store->block_min[b] = block->min;
+  store->block[b] = block;
+  store->blocks++;
+
+  return;
+}
+
+void delete_store_block(struct station_store_t *store, unsigned int b) {
+
+  free(store->block[b]->vehicle_parking);
+  free(store->block[b]);
+  memmove(&store->block_min[b], &store->block_min[b + 1],
+          sizeof(distance_t) * (store->blocks - b - 1));
+  memmove(&store->block[b], &store->block[b + 1],
+          sizeof(struct station_block_t *) * (store->blocks - b - 1));
+  store->blocks--;
+
+  return;
+}
+
+// splits a full block in two halves
+void split_store_block(struct station_store_t *store, unsigned int b) {
+
+  distance_t distances[STATION_BLOCK_DIM];
+  struct vehicle_t *parking[STATION_BLOCK_DIM];
+  struct station_block_t *block = store->block[b], *next = NULL;
+  unsigned int half = block->count / 2;
+
+  decode_station_block(block, distances);
+  decode_station_parking(block, parking);
+
+  next = malloc(sizeof(struct station_block_t) + STATION_BLOCK_DIM * 2);
+  next->offset_bytes = 2;
+  next->parked = 0;
+  next->vehicle_parking = NULL;
+  next->count = block->count - half;
+  memcpy(next->max_vehicle_autonomy, &block->max_vehicle_autonomy[half],
+         sizeof(distance_t) * next->count);
+  encode_station_parking(next, &parking[half]);
+  next = encode_station_block(next, &distances[half]);
+
+  block->count = half;
+  encode_station_parking(block, parking);
+  store->block[b] = encode_station_block(block, distances);
+  insert_store_block(store, b + 1, next);
+
+  return;
+}
+
+// moves stations between blocks b and b + 1 so that they hold the same
+// number of stations
+void even_store_blocks(struct station_store_t *store, unsigned int b) {
+
+  distance_t distances[2 * STATION_BLOCK_DIM];
+  distance_t max_vehicle_autonomy[2 * STATION_BLOCK_DIM];
+  struct vehicle_t *parking[2 * STATION_BLOCK_DIM];
+  struct station_block_t *block = store->block[b], *next = store->block[b + 1];
+  unsigned int total = block->count + next->count, half = total / 2;
+
+  decode_station_block(block, distances);
+  decode_station_block(next, &distances[block->count]);
+  decode_station_parking(block, parking);
+  decode_station_parking(next, &parking[block->count]);
+  memcpy(max_vehicle_autonomy, block->max_vehicle_autonomy,
+         sizeof(distance_t) * block->count);
+  memcpy(&max_vehicle_autonomy[block->count], next->max_vehicle_autonomy,
+         sizeof(distance_t) * next->count);
+
+  block->count = half;
+  next->count = total - half;
+  memcpy(block->max_vehicle_autonomy, max_vehicle_autonomy,
+         sizeof(distance_t) * half);
+  memcpy(next->max_vehicle_autonomy, &max_vehicle_autonomy[half],
+         sizeof(distance_t) * next->count);
+  encode_station_parking(next, &parking[half]);
+  encode_station_parking(block, parking);
+
+  store->block[b] = encode_station_block(block, distances);
+  store->block[b + 1] = encode_station_block(next, &distances[half]);
+  store->block_min[b + 1] = store->block[b + 1]->min;
+
+  return;
+}
+
+// adds an empty station, returns 0 if it already exists
+char add_stored_station(struct station_store_t *store, distance_t distance,
+                        struct station_ref_t *ref) {
+
+  distance_t distances[STATION_BLOCK_DIM];
+  struct station_block_t *block;
+  unsigned long long below;
+  unsigned int i;
+
+  if (find_stored_station(store, distance, ref))
+    return 0;
+
+  if (store->blocks == 0) {
+    block = malloc(sizeof(struct station_block_t) + STATION_BLOCK_DIM * 2);
+    block->offset_bytes = 2;
+    block->count = 1;
+    block->parked = 0;
+    block->vehicle_parking = NULL;
+    block->max_vehicle_autonomy[0] = 0;
+    block = encode_station_block(block, &distance);
+    insert_store_block(store, 0, block);
+    ref->block = 0;
+    ref->idx = 0;
+    return 1;
+  }
+
+  // a full block gives stations to a neighbour with room, and it is split
+  // only if both neighbours are full, this keeps blocks almost full
+  if (store->block[ref->block]->count == STATION_BLOCK_DIM) {
+    if (ref->block + 1 < store->blocks &&
+        store->block[ref->block + 1]->count < STATION_BLOCK_DIM - 1)
+      even_store_blocks(store, ref->block);
+    else if (ref->block > 0 &&
+             store->block[ref->block - 1]->count < STATION_BLOCK_DIM - 1)
+      even_store_blocks(store, ref->block - 1);
+    else
+      split_store_block(store, ref->block);
+    find_stored_station(store, distance, ref);
+  }
+
+  block = store->block[ref->block];
+  decode_station_block(block, distances);
+  for (i = block->count; i > ref->idx; i--) {
+    distances[i] = distances[i - 1];
+    block->max_vehicle_autonomy[i] = block->max_vehicle_autonomy[i - 1];
+  }
+  distances[ref->idx] = distance;
+  block->max_vehicle_autonomy[ref->idx] = 0;
+  block->count++;
+  // the new station has no vehicles, the ones after it move up a bit
+  below = (1ULL << ref->idx) - 1;
+  block->parked = (block->parked & below) | (block->parked & ~below) << 1;
+
+  store->block[ref->block] = encode_station_block(block, distances);
+  store->block_min[ref->block] = store->block[ref->block]->min;
+
+  return 1;
+}
+
+// merges block b + 1 into block b
+void merge_store_blocks(struct station_store_t *store, unsigned int b) {
+
+  distance_t distances[STATION_BLOCK_DIM];
+  struct vehicle_t *parking[STATION_BLOCK_DIM];
+  struct station_block_t *block = store->block[b], *next = store->block[b + 1];
+
+  decode_station_block(block, distances);
+  decode_station_block(next, &distances[block->count]);
+  decode_station_parking(block, parking);
+  decode_station_parking(next, &parking[block->count]);
+  memcpy(&block->max_vehicle_autonomy[block->count], next->max_vehicle_autonomy,
+         sizeof(distance_t) * next->count);
+  block->count += next->count;
+  encode_station_parking(block, parking);
+
+  store->block[b] = encode_station_block(block, distances);
+  delete_store_block(store, b + 1);
+
+  return;
+}
+
+// removes a station with its vehicles, returns 0 if it does not exist
+char remove_stored_station(struct station_store_t *store,
+                           distance_t distance) {
+
+  distance_t distances[STATION_BLOCK_DIM];
+  struct station_block_t *block;
+  struct vehicle_t **vehicles;
+  struct station_ref_t ref;
+  unsigned long long below;
+  unsigned int i;
+
+  if (!find_stored_station(store, distance, &ref))
+    return 0;
+
+  block = store->block[ref.block];
+  vehicles = station_block_parking(block, ref.idx);
+  if (vehicles != NULL) {
+    remove_all_vehicles(*vehicles);
+    set_station_parking(block, ref.idx, NULL);
+  }
+
+  if (block->count == 1) {
+    delete_store_block(store, ref.block);
+    return 1;
+  }
+
+  decode_station_block(block, distances);
+  for (i = ref.idx; i + 1 < block->count; i++) {
+    distances[i] = distances[i + 1];
+    block->max_vehicle_autonomy[i] = block->max_vehicle_autonomy[i + 1];
+  }
+  block->count--;
+  // the stations after the removed one move down a bit
+  below = (1ULL << ref.idx) - 1;
+  block->parked = (block->parked & below) | (block->parked >> 1 & ~below);
+
+  block = encode_station_block(block, distances);
+  store->block[ref.block] = block;
+  store->block_min[ref.block] = block->min;
+
+  // a block under a quarter full is merged with a neighbour, if they fit in
+  // half a block together
+  if (block->count < STATION_BLOCK_DIM / 4) {
+    if (ref.block + 1 < store->blocks &&
+        block->count + store->block[ref.block + 1]->count <=
+            STATION_BLOCK_DIM / 2)
+      merge_store_blocks(store, ref.block);
+    else if (ref.block > 0 &&
+             store->block[ref.block - 1]->count + block->count <=
+                 STATION_BLOCK_DIM / 2)
+      merge_store_blocks(store, ref.block - 1);
+  }
+
+  return 1;
+}
+
+// returns 0 if the station is full of vehicles with given autonomy
+char add_vehicle_to_stored_station(struct station_store_t *store,
+                                   struct station_ref_t *ref,
+                                   distance_t autonomy) {
+
+  struct station_block_t *block = store->block[ref->block];
+  struct vehicle_t **vehicles;
+  char flag = 1;
+
+  vehicles = station_block_parking(block, ref->idx);
+  if (vehicles != NULL)
+    *vehicles = add_vehicle(*vehicles, autonomy, &flag);
+  else
+    set_station_parking(block, ref->idx, add_vehicle(NULL, autonomy, &flag));
+  if (autonomy > block->max_vehicle_autonomy[ref->idx])
+    block->max_vehicle_autonomy[ref->idx] = autonomy;
+
+  return flag;
+}
+
+// returns 0 if there is no vehicle with given autonomy
+char remove_vehicle_from_stored_station(struct station_store_t *store,
+                                        struct station_ref_t *ref,
+                                        distance_t autonomy) {
+
+  struct station_block_t *block = store->block[ref->block];
+  struct vehicle_t **vehicles, *tmp;
+  char flag = 0;
+
+  vehicles = station_block_parking(block, ref->idx);
+  if (vehicles == NULL || find_vehicle(*vehicles, autonomy) == NULL)
+    return 0;
+
+  *vehicles = remove_vehicle(*vehicles, autonomy, &flag);
+  if (autonomy == block->max_vehicle_autonomy[ref->idx] && flag == 2) {
+    tmp = maximum_vehicle(*vehicles);
+    block->max_vehicle_autonomy[ref->idx] = tmp == NULL ? 0 : tmp->autonomy;
+  }
+  if (*vehicles == NULL)
+    set_station_parking(block, ref->idx, NULL);
+
+  return 1;
+}
+
+// array for BFS of the stations from begin to end, decoding only the blocks
+// between them
+struct station_graph_node_t *
+stored_vector_between(struct station_store_t *store, struct station_ref_t *begin,
+                      struct station_ref_t *end, unsigned int *num_stations) {
+
+  distance_t distances[STATION_BLOCK_DIM];
+  struct station_graph_node_t *vect;
+  struct station_block_t *block;
+  unsigned int b, i, first, last, idx;
+  distance_t max_autonomy;
+
+  *num_stations = 0;
+  for (b = begin->block; b <= end->block; b++)
+    *num_stations += store->block[b]->count;
+  *num_stations -= begin->idx + (store->block[end->block]->count - end->idx - 1);
+
+  vect = malloc(sizeof(struct station_graph_node_t) * (*num_stations));
+
+  idx = 0;
+  for (b = begin->block; b <= end->block; b++) {
+    block = store->block[b];
+    decode_station_block(block, distances);
+    first = b == begin->block ? begin->idx : 0;
+    last = b == end->block ? end->idx : block->count - 1u;
+    for (i = first; i <= last; i++) {
+      max_autonomy = block->max_vehicle_autonomy[i];
+      // same as update_reachable_stations
+      vect[idx].distance = distances[i];
+      vect[idx].rightmost_reachable_station =
+          rightmost_reachable(distances[i], max_autonomy);
+      vect[idx].leftmost_reachable_station =
+          leftmost_reachable(distances[i], max_autonomy);
+      vect[idx].color = WHITE;
+      vect[idx].prev_on_path = -1;
+      idx++;
+    }
+  }
+
+  return vect;
 }
+
+#endif
+
+/*
+pianifica-percorsi asks the routes from one station to many destinations.
+Instead of a BFS for every destination, we do one forward sweep over the
+stations after the origin and one backward sweep over the stations before
+it, then every route is read from the prev_on_path pointers.
+Going forward, search_route_forward gives every station the same
+prev_on_path whatever the end station is, so we run it without stopping.
+Going backward, search_route_backward starts from the end station and
+selects, among the routes with fewest stops, the one whose stops are
+closest to the end, starting from the end. Since we can not run it from
+every destination, we compute instead the number of stops from the origin
+to every station, and for each station the next stop towards the origin
+is the station closest to it among those one stop nearer to the origin that
+can reach it. This gives the same route as search_route_backward.
+ */
+
+// forward sweep, the origin is the first station of the array
+void sweep_routes_forward(struct station_graph_node_t *station_vector,
+                          unsigned int num_stations) {
+
+  struct station_queue_t *queue;
+  unsigned int curr, tmp;
+
+  queue = create_station_queue(INIT_STATION_QUEUE_DIM);
+
+  queue = enqueue_station(queue, 0);
+  tmp = 1;
+  while (!is_empty_station_queue(queue)) {
+    curr = dequeue_station(queue);
+
+    while (tmp < num_stations &&
+           station_vector[tmp].distance <=
+               station_vector[curr].rightmost_reachable_station) {
+      station_vector[tmp].prev_on_path = curr;
+      queue = enqueue_station(queue, tmp);
+      tmp = tmp + 1;
+    }
+  }
+
+  deallocate_station_queue(queue);
+
+  return;
+}
+
+// backward sweep, the origin is the last station of the array
+void sweep_routes_backward(struct station_graph_node_t *station_vector,
+                           unsigned int num_stations) {
+
+  // stations with the same number of stops from the origin are contiguous,
+  // level_begin and level_end delimit the ones of the current level, and
+  // the stations of the next level are all on the left of them
+  unsigned int level_begin, level_end, next_begin, curr, tmp, leftmost;
+
+  level_begin = num_stations - 1;
+  level_end = num_stations;
+
+  while (level_begin > 0) {
+
+    // the next level are the stations that can be reached from the
+    // current one and were not reached before
+    leftmost = station_vector[level_begin].leftmost_reachable_station;
+    for (curr = level_begin + 1; curr < level_end; curr++)
+      if (station_vector[curr].leftmost_reachable_station < leftmost)
+        leftmost = station_vector[curr].leftmost_reachable_station;
+
+    next_begin = level_begin;
+    while (next_begin > 0 &&
+           station_vector[next_begin - 1].distance >= leftmost)
+      next_begin--;
+
+    if (next_begin == level_begin)
+      break;
+
+    // the next stop of a station is the first station of the current level
+    // that can reach it: going left the stations are harder to reach, so
+    // the first one can only move right
+    tmp = level_begin;
+    curr = level_begin;
+    while (curr > next_begin) {
+      curr--;
+      while (station_vector[tmp].leftmost_reachable_station >
+             station_vector[curr].distance)
+        tmp++;
+      station_vector[curr].prev_on_path = tmp;
+    }
+
+    level_end = level_begin;
+    level_begin = next_begin;
+  }
+
+  return;
+}
+
+// index of the station with given distance in the array, -1 if missing
+int station_index(struct station_graph_node_t *station_vector,
+                  unsigned int num_stations, distance_t distance) {
+
+  unsigned int low = 0, high = num_stations;
+
+  while (low < high) {
+    unsigned int mid = low + (high - low) / 2;
+    if (station_vector[mid].distance < distance)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  if (low < num_stations && station_vector[low].distance == distance)
+    return low;
+
+  return -1;
+}
+
+// prints the route from the station origin of the array to every
+// destination, one per line
+void print_routes_from(struct station_graph_node_t *station_vector,
+                       unsigned int num_stations, unsigned int origin,
+                       distance_t *destinations,
+                       unsigned int num_destinations, FILE *out) {
+
+  struct station_graph_node_t *forward_vector = station_vector + origin;
+  int idx;
+
+  sweep_routes_forward(forward_vector, num_stations - origin);
+  sweep_routes_backward(station_vector, origin + 1);
+
+  for (unsigned int i = 0; i < num_destinations; i++) {
+    idx = station_index(station_vector, num_stations, destinations[i]);
+
+    if (idx == (int)origin)
+      fprintf(out, DISTANCE_FORMAT "\n", station_vector[origin].distance);
+    else if (idx > (int)origin &&
+             forward_vector[idx - origin].prev_on_path != -1)
+      print_route_reverse(forward_vector, idx - origin, idx - origin, out);
+    else if (idx >= 0 && idx < (int)origin &&
+             station_vector[idx].prev_on_path != -1)
+      print_route_reverse(station_vector, idx, idx, out);
+    else
+      fprintf(out, "nessun percorso\n");
+  }
+
+  return;
+}
+
+/*
+Every command read from the input is parsed into a command_t before being
+executed, so that the same command can be executed right away or handed to
+another thread. A command can be preceded by a highway identifier, an
+unsigned integer: commands without it refer to highway 0, so the input
+format of the specification is still valid.
+ */
+enum command_type_t {
+  UNKNOWN_COMMAND = 0,
+  ADD_STATION = 1,    // aggiungi-stazione
+  REMOVE_STATION = 2, // demolisci-stazione
+  ADD_VEHICLE = 3,    // aggiungi-auto
+  REMOVE_VEHICLE = 4, // rottama-auto
+  PLAN_ROUTE = 5,     // pianifica-percorso
+  EXIT_COMMAND = 6,   // not in the input, used to stop worker threads
+  PLAN_ROUTES = 7,    // pianifica-percorsi
+};
+
+struct command_t {
+  enum command_type_t type;
+  unsigned int highway;
+  distance_t station_distance;
+  // vehicle autonomy, end station distance or number of values
+  distance_t argument;
+  // autonomies of the vehicles of aggiungi-stazione or distances of the
+  // destinations of pianifica-percorsi, NULL if none
+  distance_t *values;
+  // stations looked up before execution, see resolve_command
+  struct station_t *station;
+  struct station_t *end_station;
+};
+
+// reads the number of values followed by the values
+void parse_values(FILE *in, struct command_t *command) {
+  distance_t values_number, value;
+
+  if (fscanf(in, DISTANCE_FORMAT, &command->argument) == 1 &&
+      command->argument > 0) {
+    values_number = command->argument;
+    command->argument = 0;
+    if (values_number <= SIZE_MAX / sizeof(distance_t))
+      command->values = malloc(sizeof(distance_t) * values_number);
+    // without memory the values are still read, so that the next command
+    // is parsed from the right place, and the command gets none
+    for (distance_t i = 0; i < values_number; i++) {
+      if (fscanf(in, DISTANCE_FORMAT, &value) != 1)
+        break;
+      if (command->values != NULL)
+        command->values[command->argument++] = value;
+    }
+  }
+
+  return;
+}
+
+// returns 0 at EOF, 1 otherwise
+int parse_command(FILE *in, struct command_t *command) {
+
+  char token[19];
+
+  command->type = UNKNOWN_COMMAND;
+  command->highway = 0;
+  command->argument = 0;
+  command->values = NULL;
+
+  if (fscanf(in, "%18s", token) == EOF)
+    return 0;
+
+  // a leading number is the highway identifier
+  if (token[0] >= '0' && token[0] <= '9') {
+    command->highway = strtoul(token, NULL, 10);
+    if (fscanf(in, "%18s", token) == EOF)
+      return 0;
+  }
+
+  if (fscanf(in, DISTANCE_FORMAT, &command->station_distance) == EOF)
+    return 0;
+
+  /*
+   * To avoid the use of strcmp, we can simply check
+   * letter in position number 12 of the captured string,
+   * which is different for every command:
+   * aggiungi-stazione  -> z
+   * demolisci-stazione -> a
+   * aggiungi-auto      -> o
+   * rottama-auto       -> \0 null character
+   * pianifica-percorso -> r
+   * pianifica-percorsi -> r, told apart by the last letter
+   */
+  switch (token[12]) {
+  // aggiungi-stazione
+  case 'z':
+    command->type = ADD_STATION;
+    parse_values(in, command);
+    break;
+  // demolisci-stazione
+  case 'a':
+    command->type = REMOVE_STATION;
+    break;
+  // aggiungi-auto
+  case 'o':
+    if (fscanf(in, DISTANCE_FORMAT, &command->argument) == 1)
+      command->type = ADD_VEHICLE;
+    break;
+  // rottama-auto
+  case '\0':
+    if (fscanf(in, DISTANCE_FORMAT, &command->argument) == 1)
+      command->type = REMOVE_VEHICLE;
+    break;
+  // pianifica-percorso and pianifica-percorsi
+  case 'r':
+    if (token[17] == 'i') {
+      command->type = PLAN_ROUTES;
+      parse_values(in, command);
+    } else if (fscanf(in, DISTANCE_FORMAT, &command->argument) == 1)
+      command->type = PLAN_ROUTE;
+    break;
+  }
+
+  return 1;
+}
+
+// Every highway is independent from the others and has its own stations
+struct highway_t {
+  unsigned int id;
+  unsigned int stations_number;
+  struct station_t *stations; // root of the AVL tree of stations
+#ifdef COMPACT_STATIONS
+  // used instead of the tree of stations
+  struct station_store_t store;
+#endif
+#ifdef RANGE_PARTITIONS
+  // lowest distance of the stations of each partition, lower[0] is always 0
+  distance_t lower[RANGE_PARTITIONS];
+  // the stations of each partition are a highway owned by a worker
+  struct highway_t *partition[RANGE_PARTITIONS];
+#endif
+};
+
+#ifdef RANGE_PARTITIONS
+// at the beginning the distance range is split evenly among partitions, then
+// the partitions are rebalanced on the stations actually added
+void init_partitions(struct highway_t *highway) {
+
+  for (unsigned int p = 0; p < RANGE_PARTITIONS; p++) {
+    highway->lower[p] = DISTANCE_MAX / RANGE_PARTITIONS * p;
+    highway->partition[p] = malloc(sizeof(struct highway_t));
+    highway->partition[p]->id = highway->id;
+    highway->partition[p]->stations_number = 0;
+    highway->partition[p]->stations = NULL;
+  }
+
+  return;
+}
+#endif
+
+// initial dimension of the highway table, this will increase at powers of 2
+#define INIT_HIGHWAY_TABLE_DIM 8
+
+/*
+Highways are kept in an open addressing hash table indexed by identifier.
+Almost every input refers to a single highway, so the lookup is a single
+probe in the common case.
+ */
+struct highway_table_t {
+  struct highway_t **slot;
+  unsigned int dim; // always a power of 2
+  unsigned int count;
+};
+
+void init_highway_table(struct highway_table_t *table) {
+
+  table->dim = INIT_HIGHWAY_TABLE_DIM;
+  table->count = 0;
+  table->slot = calloc(table->dim, sizeof(struct highway_t *));
+
+  return;
+}
+
+// linear probing, returns the slot of the highway or the empty slot where it
+// has to be inserted
+struct highway_t **highway_slot(struct highway_table_t *table,
+                                unsigned int id) {
+
+  unsigned int idx = (id * 2654435761u) & (table->dim - 1);
+
+  while (table->slot[idx] != NULL && table->slot[idx]->id != id)
+    idx = (idx + 1) & (table->dim - 1);
+
+  return &table->slot[idx];
+}
+
+void grow_highway_table(struct highway_table_t *table) {
+
+  struct highway_table_t res;
+  res.dim = table->dim << 1;
+  res.count = table->count;
+  res.slot = calloc(res.dim, sizeof(struct highway_t *));
+
+  for (unsigned int i = 0; i < table->dim; i++) {
+    if (table->slot[i] != NULL)
+      *highway_slot(&res, table->slot[i]->id) = table->slot[i];
+  }
+
+  free(table->slot);
+  *table = res;
+
+  return;
+}
+
+// returns the highway with given identifier, creating it if it is new
+struct highway_t *get_highway(struct highway_table_t *table, unsigned int id) {
+
+  struct highway_t **slot;
+  slot = highway_slot(table, id);
+  if (*slot != NULL)
+    return *slot;
+
+  // we keep the load factor under 1/2
+  if ((table->count + 1) * 2 > table->dim) {
+    grow_highway_table(table);
+    slot = highway_slot(table, id);
+  }
+
+  *slot = malloc(sizeof(struct highway_t));
+  (*slot)->id = id;
+  (*slot)->stations_number = 0;
+  (*slot)->stations = NULL;
+#ifdef COMPACT_STATIONS
+  init_station_store(&(*slot)->store);
+#endif
+#ifdef RANGE_PARTITIONS
+  init_partitions(*slot);
+#endif
+  table->count++;
+
+  return *slot;
+}
+
+void remove_all_highways(struct highway_table_t *table) {
+
+  for (unsigned int i = 0; i < table->dim; i++) {
+    if (table->slot[i] != NULL) {
+      remove_all_stations(table->slot[i]->stations);
+#ifdef COMPACT_STATIONS
+      remove_station_store(&table->slot[i]->store);
+#endif
+#ifdef RANGE_PARTITIONS
+      for (unsigned int p = 0; p < RANGE_PARTITIONS; p++) {
+        remove_all_stations(table->slot[i]->partition[p]->stations);
+        free(table->slot[i]->partition[p]);
+      }
+#endif
+      free(table->slot[i]);
+    }
+  }
+
+  free(table->slot);
+  table->slot = NULL;
+
+  return;
+}
+
+/*
+aggiungi-auto, rottama-auto and pianifica-percorso look up their stations
+before being executed, so that the lookups of many commands can be done
+together. This is possible because those commands never add or remove
+stations, so between two aggiungi-stazione or demolisci-stazione commands
+the station trees do not change.
+ */
+char changes_stations(struct command_t *command) {
+  return command->type == ADD_STATION || command->type == REMOVE_STATION;
+}
+
+// A station lookup in progress
+struct station_lookup_t {
+  distance_t distance;
+  struct station_t *node; // current node of the descent, then the result
+  struct station_t **result;
+};
+
+/*
+Every descent of find_station is a chain of dependent cache misses, one
+for each level of the tree. Here we advance all the lookups one level at a
+time, prefetching the next node of each one, so that the cache misses of
+different lookups overlap instead of being paid one after the other.
+ */
+void find_stations_interleaved(struct station_lookup_t *lookups,
+                               unsigned int n) {
+
+  unsigned int i, descending;
+  struct station_t *node;
+
+  do {
+    descending = 0;
+    for (i = 0; i < n; i++) {
+      node = lookups[i].node;
+      // the lookup is over if we fell off the tree or found the station
+      if (node == NULL || node->distance == lookups[i].distance)
+        continue;
+      node = lookups[i].distance < node->distance ? node->left : node->right;
+      if (node != NULL)
+        __builtin_prefetch(node);
+      lookups[i].node = node;
+      descending++;
+    }
+  } while (descending > 0);
+
+  for (i = 0; i < n; i++)
+    *lookups[i].result = lookups[i].node;
+
+  return;
+}
+
+// maximum number of commands read ahead and executed together
+#define COMMAND_BATCH_DIM 64
+
+void add_station_lookup(struct station_lookup_t *lookup,
+                        struct highway_t *highway, distance_t distance,
+                        struct station_t **result) {
+
+  lookup->distance = distance;
+  lookup->node = highway->stations;
+  lookup->result = result;
+  if (lookup->node != NULL)
+    __builtin_prefetch(lookup->node);
+
+  return;
+}
+
+void add_station_lookups(struct station_lookup_t *lookups,
+                         unsigned int *num_lookups, struct highway_t *highway,
+                         struct command_t *command) {
+
+  command->station = NULL;
+  command->end_station = NULL;
+
+  if (command->type == ADD_VEHICLE || command->type == REMOVE_VEHICLE ||
+      command->type == PLAN_ROUTE || command->type == PLAN_ROUTES)
+    add_station_lookup(&lookups[(*num_lookups)++], highway,
+                       command->station_distance, &command->station);
+  if (command->type == PLAN_ROUTE)
+    add_station_lookup(&lookups[(*num_lookups)++], highway, command->argument,
+                       &command->end_station);
+
+  return;
+}
+
+// looks up the stations of a single command
+void resolve_command(struct highway_t *highway, struct command_t *command) {
+
+  struct station_lookup_t lookups[2];
+  unsigned int num_lookups = 0;
+
+  add_station_lookups(lookups, &num_lookups, highway, command);
+  find_stations_interleaved(lookups, num_lookups);
+
+  return;
+}
+
+void execute_command(struct highway_t *highway, struct command_t *command,
+                     FILE *out);
+void run_command(struct highway_t *highway, struct command_t *command,
+                 FILE *out);
+
+// pianifica-percorsi, the origin must have been looked up already
+void plan_routes(struct highway_t *highway, struct command_t *command,
+                 FILE *out) {
+
+  struct station_t *origin = command->station, *first, *last, **destinations;
+  struct station_graph_node_t *station_vector;
+  struct station_lookup_t *lookups;
+  unsigned int num_stations, i;
+
+  if (origin == NULL) {
+    for (i = 0; i < command->argument; i++)
+      fprintf(out, "nessun percorso\n");
+    free(command->values);
+    command->values = NULL;
+    return;
+  }
+
+  destinations = malloc(sizeof(struct station_t *) * command->argument);
+  lookups = malloc(sizeof(struct station_lookup_t) * command->argument);
+  for (i = 0; i < command->argument; i++)
+    add_station_lookup(&lookups[i], highway, command->values[i],
+                       &destinations[i]);
+  find_stations_interleaved(lookups, command->argument);
+
+  // the array goes from the first to the last station among the origin and
+  // the destinations
+  first = origin;
+  last = origin;
+  for (i = 0; i < command->argument; i++) {
+    if (destinations[i] != NULL && destinations[i]->distance < first->distance)
+      first = destinations[i];
+    if (destinations[i] != NULL && destinations[i]->distance > last->distance)
+      last = destinations[i];
+  }
+
+  num_stations = number_of_stations_between(first, last);
+  station_vector = malloc(sizeof(struct station_graph_node_t) * num_stations);
+  vector_of_stations_between(station_vector, first, last);
+
+  print_routes_from(
+      station_vector, num_stations,
+      station_index(station_vector, num_stations, origin->distance),
+      command->values, command->argument, out);
+
+  free(station_vector);
+  free(lookups);
+  free(destinations);
+  free(command->values);
+  command->values = NULL;
+
+  return;
+}
+
+// executes a batch of commands in order: the lookups of every run of
+// commands that do not change stations are done together before the run
+void execute_batch(struct highway_table_t *highways,
+                   struct command_t *commands, unsigned int n, FILE *out) {
+
+  struct highway_t *highway[COMMAND_BATCH_DIM];
+  unsigned int i;
+#ifndef COMPACT_STATIONS
+  struct station_lookup_t lookups[2 * COMMAND_BATCH_DIM];
+  unsigned int begin, end, num_lookups;
+#endif
+
+  for (i = 0; i < n; i++)
+    highway[i] = get_highway(highways, commands[i].highway);
+
+#ifdef COMPACT_STATIONS
+  // stored stations are found with a binary search on a small directory,
+  // there are no long chains of cache misses to overlap
+  for (i = 0; i < n; i++)
+    run_command(highway[i], &commands[i], out);
+#else
+  begin = 0;
+  while (begin < n) {
+    num_lookups = 0;
+    for (end = begin; end < n && !changes_stations(&commands[end]); end++)
+      add_station_lookups(lookups, &num_lookups, highway[end], &commands[end]);
+
+    find_stations_interleaved(lookups, num_lookups);
+
+    for (i = begin; i < end; i++)
+      execute_command(highway[i], &commands[i], out);
+
+    // the command that changes stations, if any, closes the run
+    if (end < n) {
+      execute_command(highway[end], &commands[end], out);
+      end++;
+    }
+
+    begin = end;
+  }
+#endif
+
+  return;
+}
+
+// executes a parsed command on its highway, printing the answer on out.
+// Its stations must have been looked up already
+void execute_command(struct highway_t *highway, struct command_t *command,
+                     FILE *out) {
+
+  struct station_t *station; // the station on which we do operations
+  struct station_queue_t *queue = NULL; // Pointer to queue
+  char flag;
+
+  switch (command->type) {
+  case ADD_STATION:
+    // We check that the station does not already exist
+    station = NULL;
+    highway->stations =
+        add_station(highway->stations, command->station_distance, &station);
+    highway->stations->parent = NULL;
+    if (station != NULL) {
+
+      // fix next prev pointers
+      struct station_t *tmp;
+      tmp = predecessor_station(station);
+      if (tmp != NULL) {
+        station->prev = tmp;
+        station->next = tmp->next;
+        tmp->next = station;
+        if (station->next != NULL)
+          station->next->prev = station;
+      } else {
+        tmp = successor_station(station);
+        station->next = tmp;
+        if (tmp != NULL)
+          tmp->prev = station;
+      }
+
+      for (int i = 0; i < command->argument; i++)
+        add_vehicle_to_station(station, command->values[i]);
+
+      highway->stations_number++;
+
+      fprintf(out, "aggiunta\n");
+    } else {
+      fprintf(out, "non aggiunta\n");
+    }
+    free(command->values);
+    command->values = NULL;
+    break;
+  case REMOVE_STATION:
+    // Try to remove station with given distance.
+    // If all goes well the flag is set to 1
+    flag = 0;
+    highway->stations =
+        remove_station(highway->stations, command->station_distance, &flag);
+    if (highway->stations != NULL)
+      highway->stations->parent = NULL;
+    if (flag == 1) {
+      highway->stations_number--;
+      fprintf(out, "demolita\n");
+    } else {
+      fprintf(out, "non demolita\n");
+    }
+    break;
+  case ADD_VEHICLE:
+    // Check if station with given distance exists.
+    // If exists it has been found by the lookup, else it is NULL.
+    // A station full of vehicles with the same autonomy takes no more
+    station = command->station;
+    if (station != NULL &&
+        add_vehicle_to_station(station, command->argument)) {
+      fprintf(out, "aggiunta\n");
+    } else {
+      fprintf(out, "non aggiunta\n");
+    }
+    break;
+  case REMOVE_VEHICLE:
+    // Check if the station exists then check
+    // if the car has been removed or not
+    station = command->station;
+    if (station != NULL &&
+        find_vehicle(station->vehicle_parking, command->argument) != NULL) {
+      remove_vehicle_from_station(station, command->argument);
+      fprintf(out, "rottamata\n");
+    } else {
+      fprintf(out, "non rottamata\n");
+    }
+    break;
+  case PLAN_ROUTE:
+    if (command->station != NULL && command->end_station != NULL)
+      plan_route(highway->stations, command->station, command->end_station,
+                 &queue, out);
+    else
+      fprintf(out, "nessun percorso\n");
+    break;
+  case PLAN_ROUTES:
+    plan_routes(highway, command, out);
+    break;
+  default:
+    break;
+  }
+
+  return;
+}
+
+#ifdef COMPACT_STATIONS
+// pianifica-percorso on the compact store
+void plan_stored_route(struct station_store_t *store,
+                       struct command_t *command, FILE *out) {
+
+  struct station_ref_t begin, end;
+  struct station_graph_node_t *station_vector;
+  struct station_queue_t *queue = NULL;
+  unsigned int num_stations;
+
+  if (!find_stored_station(store, command->station_distance, &begin) ||
+      !find_stored_station(store, command->argument, &end)) {
+    fprintf(out, "nessun percorso\n");
+    return;
+  }
+
+  if (command->station_distance == command->argument) {
+    fprintf(out, DISTANCE_FORMAT "\n", command->station_distance);
+    return;
+  }
+
+  if (command->station_distance < command->argument) {
+    station_vector = stored_vector_between(store, &begin, &end, &num_stations);
+    search_route_forward(station_vector, num_stations, &queue, out);
+  } else {
+    station_vector = stored_vector_between(store, &end, &begin, &num_stations);
+    search_route_backward(station_vector, num_stations, &queue, out);
+  }
+
+  free(station_vector);
+
+  return;
+}
+
+// pianifica-percorsi on the compact store
+void plan_stored_routes(struct station_store_t *store,
+                        struct command_t *command, FILE *out) {
+
+  struct station_ref_t origin, first, last, destination;
+  struct station_graph_node_t *station_vector;
+  unsigned int num_stations, i;
+  distance_t first_distance, last_distance;
+
+  if (!find_stored_station(store, command->station_distance, &origin)) {
+    for (i = 0; i < command->argument; i++)
+      fprintf(out, "nessun percorso\n");
+    free(command->values);
+    command->values = NULL;
+    return;
+  }
+
+  first = origin;
+  last = origin;
+  first_distance = last_distance = command->station_distance;
+  for (i = 0; i < command->argument; i++) {
+    if (!find_stored_station(store, command->values[i], &destination))
+      continue;
+    if (command->values[i] < first_distance) {
+      first = destination;
+      first_distance = command->values[i];
+    }
+    if (command->values[i] > last_distance) {
+      last = destination;
+      last_distance = command->values[i];
+    }
+  }
+
+  station_vector = stored_vector_between(store, &first, &last, &num_stations);
+
+  print_routes_from(
+      station_vector, num_stations,
+      station_index(station_vector, num_stations, command->station_distance),
+      command->values, command->argument, out);
+
+  free(station_vector);
+  free(command->values);
+  command->values = NULL;
+
+  return;
+}
+
+// same as execute_command, on the compact store
+void execute_stored_command(struct highway_t *highway,
+                            struct command_t *command, FILE *out) {
+
+  struct station_store_t *store = &highway->store;
+  struct station_ref_t ref;
+
+  switch (command->type) {
+  case ADD_STATION:
+    if (add_stored_station(store, command->station_distance, &ref)) {
+      for (int i = 0; i < command->argument; i++)
+        add_vehicle_to_stored_station(store, &ref, command->values[i]);
+      highway->stations_number++;
+      fprintf(out, "aggiunta\n");
+    } else {
+      fprintf(out, "non aggiunta\n");
+    }
+    free(command->values);
+    command->values = NULL;
+    break;
+  case REMOVE_STATION:
+    if (remove_stored_station(store, command->station_distance)) {
+      highway->stations_number--;
+      fprintf(out, "demolita\n");
+    } else {
+      fprintf(out, "non demolita\n");
+    }
+    break;
+  case ADD_VEHICLE:
+    if (find_stored_station(store, command->station_distance, &ref) &&
+        add_vehicle_to_stored_station(store, &ref, command->argument)) {
+      fprintf(out, "aggiunta\n");
+    } else {
+      fprintf(out, "non aggiunta\n");
+    }
+    break;
+  case REMOVE_VEHICLE:
+    if (find_stored_station(store, command->station_distance, &ref) &&
+        remove_vehicle_from_stored_station(store, &ref, command->argument))
+      fprintf(out, "rottamata\n");
+    else
+      fprintf(out, "non rottamata\n");
+    break;
+  case PLAN_ROUTE:
+    plan_stored_route(store, command, out);
+    break;
+  case PLAN_ROUTES:
+    plan_stored_routes(store, command, out);
+    break;
+  default:
+    break;
+  }
+
+  return;
+}
+#endif
+
+// executes a single command, looking up its stations first
+void run_command(struct highway_t *highway, struct command_t *command,
+                 FILE *out) {
+
+#ifdef COMPACT_STATIONS
+  execute_stored_command(highway, command, out);
+#else
+  resolve_command(highway, command);
+  execute_command(highway, command, out);
+#endif
+
+  return;
+}
+
+#ifdef WORKER_THREADS
+/*
+Threaded execution: the main thread parses the input and sends every
+command to a worker thread through a lock-free single producer single
+consumer ring. Every worker sends back the output of each command through
+another ring, and the main thread prints them in input order: it remembers
+the worker of every command still in flight, and since each worker answers
+its commands in order, the next output to print is always the head of the
+output ring of the worker of the oldest command.
+The main thread owns the highway table, a worker only touches the stations
+of the highways, or partitions, of the commands it receives.
+ */
+
+// dimensions of the rings, they must be powers of 2
+#define COMMAND_RING_DIM 1024
+#define OUTPUT_RING_DIM 1024
+
+// head and tail are on different cache lines to avoid false sharing
+struct spsc_ring_t {
+  _Alignas(64) atomic_size_t head; // next element to pop, owned by consumer
+  _Alignas(64) atomic_size_t tail; // next free slot, owned by producer
+  _Alignas(64) size_t elem_size;
+  size_t mask;
+  char *buffer;
+};
+
+void init_spsc_ring(struct spsc_ring_t *ring, size_t dim, size_t elem_size) {
+
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->elem_size = elem_size;
+  ring->mask = dim - 1;
+  ring->buffer = malloc(dim * elem_size);
+
+  return;
+}
+
+// returns 0 if the ring is full
+int spsc_ring_push(struct spsc_ring_t *ring, const void *elem) {
+
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) >
+      ring->mask)
+    return 0;
+
+  memcpy(ring->buffer + (tail & ring->mask) * ring->elem_size, elem,
+         ring->elem_size);
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+  return 1;
+}
+
+// returns 0 if the ring is empty
+int spsc_ring_pop(struct spsc_ring_t *ring, void *elem) {
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+    return 0;
+
+  memcpy(elem, ring->buffer + (head & ring->mask) * ring->elem_size,
+         ring->elem_size);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+  return 1;
+}
+
+// a command together with the highway, or partition, it is executed on
+struct job_t {
+  struct command_t command;
+  struct highway_t *highway;
+};
+
+// output of a single command, text is allocated by open_memstream
+struct output_message_t {
+  char *text;
+  size_t len;
+};
+
+struct worker_t {
+  pthread_t thread;
+  struct spsc_ring_t jobs;
+  struct spsc_ring_t outputs;
+};
+
+void *worker_loop(void *arg) {
+
+  struct worker_t *worker = arg;
+  struct job_t job;
+  struct output_message_t message;
+  FILE *out;
+
+  while (1) {
+    while (!spsc_ring_pop(&worker->jobs, &job))
+      sched_yield();
+
+    if (job.command.type == EXIT_COMMAND)
+      break;
+
+    out = open_memstream(&message.text, &message.len);
+    run_command(job.highway, &job.command, out);
+    fclose(out);
+
+    while (!spsc_ring_push(&worker->outputs, &message))
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+/*
+Workers of the commands in flight, in input order. Each worker holds at
+most a full job ring, a full output ring, and one command it is
+executing and one output it is trying to push, so this never overflows.
+ */
+#define PENDING_DIM (WORKER_THREADS * (COMMAND_RING_DIM + OUTPUT_RING_DIM + 2))
+
+struct pending_t {
+  unsigned int worker[PENDING_DIM];
+  unsigned int head;
+  unsigned int count;
+};
+
+// prints the outputs that are ready, in input order
+void flush_outputs(struct worker_t *workers, struct pending_t *pending) {
+
+  struct output_message_t message;
+
+  while (pending->count > 0 &&
+         spsc_ring_pop(&workers[pending->worker[pending->head]].outputs,
+                       &message)) {
+    fwrite(message.text, 1, message.len, stdout);
+    free(message.text);
+    pending->head = (pending->head + 1) % PENDING_DIM;
+    pending->count--;
+  }
+
+  return;
+}
+
+void dispatch_job(struct worker_t *workers, struct pending_t *pending,
+                  struct job_t *job, unsigned int worker) {
+
+  while (!spsc_ring_push(&workers[worker].jobs, job)) {
+    flush_outputs(workers, pending);
+    sched_yield();
+  }
+
+  pending->worker[(pending->head + pending->count) % PENDING_DIM] = worker;
+  pending->count++;
+
+  return;
+}
+
+// waits until every command dispatched so far has been executed and its
+// output printed. After this the main thread can safely read and modify
+// every highway, until it dispatches a new job
+void wait_for_workers(struct worker_t *workers, struct pending_t *pending) {
+
+  while (pending->count > 0) {
+    flush_outputs(workers, pending);
+    if (pending->count > 0)
+      sched_yield();
+  }
+
+  return;
+}
+
+void start_workers(struct worker_t *workers) {
+
+  for (unsigned int i = 0; i < WORKER_THREADS; i++) {
+    init_spsc_ring(&workers[i].jobs, COMMAND_RING_DIM, sizeof(struct job_t));
+    init_spsc_ring(&workers[i].outputs, OUTPUT_RING_DIM,
+                   sizeof(struct output_message_t));
+    pthread_create(&workers[i].thread, NULL, &worker_loop, &workers[i]);
+  }
+
+  return;
+}
+
+void stop_workers(struct worker_t *workers, struct pending_t *pending) {
+
+  struct job_t job;
+
+  wait_for_workers(workers, pending);
+
+  // the exit command does not produce any output, so it is not pending
+  job.command.type = EXIT_COMMAND;
+  job.highway = NULL;
+  for (unsigned int i = 0; i < WORKER_THREADS; i++) {
+    while (!spsc_ring_push(&workers[i].jobs, &job))
+      sched_yield();
+    pthread_join(workers[i].thread, NULL);
+    free(workers[i].jobs.buffer);
+    free(workers[i].outputs.buffer);
+  }
+
+  return;
+}
+#endif
+
+#ifdef RANGE_PARTITIONS
+/*
+Range partitioned execution: compiling with -DRANGE_PARTITIONS=<n> -lpthread
+splits the stations of every highway in n contiguous distance ranges, each
+one with its own station tree owned by a worker thread. Commands on
+stations and vehicles are sent to the worker of the partition of their
+distance. pianifica-percorso and pianifica-percorsi wait for all the
+previous commands, then the main thread builds the array of the stations
+they need walking the partitions it spans, and searches the routes on it
+as plan_route and plan_routes do.
+Every REBALANCE_PERIOD commands, and before every route, the partitions are
+rebalanced if one of them holds more than twice the average number of
+stations.
+ */
+
+#ifndef REBALANCE_PERIOD
+#define REBALANCE_PERIOD 65536
+#endif
+
+// the partition that owns a distance is the last one starting before it
+unsigned int partition_of(struct highway_t *highway, distance_t distance) {
+
+  unsigned int p = RANGE_PARTITIONS - 1;
+
+  while (highway->lower[p] > distance)
+    p--;
+
+  return p;
+}
+
+// station with given distance, looked up in its partition
+struct station_t *find_partitioned_station(struct highway_t *highway,
+                                           distance_t distance) {
+
+  return find_station(
+      highway->partition[partition_of(highway, distance)]->stations, distance);
+}
+
+// next station on the highway, *p is the partition of the station and it is
+// updated when we move to the first station of a following partition
+struct station_t *next_partitioned_station(struct highway_t *highway,
+                                           struct station_t *station,
+                                           unsigned int *p) {
+
+  if (station->next != NULL)
+    return station->next;
+
+  while (++(*p) < RANGE_PARTITIONS) {
+    if (highway->partition[*p]->stations != NULL)
+      return minimum_station(highway->partition[*p]->stations);
+  }
+
+  return NULL;
+}
+
+// array of the stations from begin to end, following next pointers and
+// jumping from a partition to the next one
+struct station_graph_node_t *
+partitioned_vector_between(struct highway_t *highway, struct station_t *begin,
+                           struct station_t *end, unsigned int *num_stations) {
+
+  struct station_graph_node_t *vect;
+  struct station_t *curr;
+  unsigned int p, idx;
+
+  // first pass to allocate an array of perfect size
+  *num_stations = 1;
+  p = partition_of(highway, begin->distance);
+  for (curr = begin; curr != end;
+       curr = next_partitioned_station(highway, curr, &p))
+    (*num_stations)++;
+
+  vect = malloc(sizeof(struct station_graph_node_t) * (*num_stations));
+
+  idx = 0;
+  p = partition_of(highway, begin->distance);
+  for (curr = begin; idx < *num_stations;
+       curr = next_partitioned_station(highway, curr, &p)) {
+    vect[idx].distance = curr->distance;
+    vect[idx].color = WHITE;
+    vect[idx].rightmost_reachable_station = curr->rightmost_reachable_station;
+    vect[idx].leftmost_reachable_station = curr->leftmost_reachable_station;
+    vect[idx].prev_on_path = -1;
+    idx++;
+  }
+
+  return vect;
+}
+
+// same as the pianifica-percorso case of execute_command, but on partitions
+void plan_partitioned_route(struct highway_t *highway,
+                            struct command_t *command, FILE *out) {
+
+  struct station_t *begin_station, *end_station;
+  struct station_graph_node_t *station_vector;
+  struct station_queue_t *queue = NULL;
+  unsigned int num_stations;
+
+  begin_station = find_partitioned_station(highway, command->station_distance);
+  end_station = find_partitioned_station(highway, command->argument);
+
+  if (begin_station == NULL || end_station == NULL) {
+    fprintf(out, "nessun percorso\n");
+    return;
+  }
+
+  if (begin_station->distance == end_station->distance) {
+    fprintf(out, DISTANCE_FORMAT "\n", begin_station->distance);
+    return;
+  }
+
+  if (begin_station->distance < end_station->distance) {
+    station_vector = partitioned_vector_between(highway, begin_station,
+                                                end_station, &num_stations);
+    search_route_forward(station_vector, num_stations, &queue, out);
+  } else {
+    station_vector = partitioned_vector_between(highway, end_station,
+                                                begin_station, &num_stations);
+    search_route_backward(station_vector, num_stations, &queue, out);
+  }
+
+  free(station_vector);
+
+  return;
+}
+
+// same as plan_routes, but on partitions
+void plan_partitioned_routes(struct highway_t *highway,
+                             struct command_t *command, FILE *out) {
+
+  struct station_t *origin, *first, *last, *destination;
+  struct station_graph_node_t *station_vector;
+  unsigned int num_stations, i;
+
+  origin = find_partitioned_station(highway, command->station_distance);
+
+  if (origin == NULL) {
+    for (i = 0; i < command->argument; i++)
+      fprintf(out, "nessun percorso\n");
+    free(command->values);
+    return;
+  }
+
+  first = origin;
+  last = origin;
+  for (i = 0; i < command->argument; i++) {
+    destination = find_partitioned_station(highway, command->values[i]);
+    if (destination != NULL && destination->distance < first->distance)
+      first = destination;
+    if (destination != NULL && destination->distance > last->distance)
+      last = destination;
+  }
+
+  station_vector =
+      partitioned_vector_between(highway, first, last, &num_stations);
+
+  print_routes_from(
+      station_vector, num_stations,
+      station_index(station_vector, num_stations, origin->distance),
+      command->values, command->argument, out);
+
+  free(station_vector);
+  free(command->values);
+
+  return;
+}
+
+// builds a perfectly balanced AVL tree from stations sorted by distance,
+// relinking their next and prev pointers
+struct station_t *build_station_tree(struct station_t **sorted,
+                                     unsigned int begin, unsigned int end,
+                                     struct station_t *parent) {
+
+  if (begin == end)
+    return NULL;
+
+  unsigned int mid = begin + (end - begin) / 2;
+  struct station_t *station = sorted[mid];
+
+  station->parent = parent;
+  station->left = build_station_tree(sorted, begin, mid, station);
+  station->right = build_station_tree(sorted, mid + 1, end, station);
+  station->height =
+      MAX(station_height(station->left), station_height(station->right)) + 1;
+
+  return station;
+}
+
+// moves the partition boundaries so that every partition holds the same
+// number of stations. Workers must be idle
+void rebalance_partitions(struct highway_t *highway) {
+
+  unsigned int total = 0, largest = 0, p, idx, begin, end;
+  struct station_t **sorted, *curr;
+
+  for (p = 0; p < RANGE_PARTITIONS; p++) {
+    total += highway->partition[p]->stations_number;
+    largest = MAX(largest, highway->partition[p]->stations_number);
+  }
+
+  // small highways are not worth it, and every partition must get at least
+  // a station so that the lower bounds stay strictly increasing
+  if (total < 2 * RANGE_PARTITIONS ||
+      (unsigned long long)largest * RANGE_PARTITIONS <= 2ull * total)
+    return;
+
+  sorted = malloc(sizeof(struct station_t *) * total);
+
+  idx = 0;
+  for (p = 0; p < RANGE_PARTITIONS; p++) {
+    for (curr = minimum_station(highway->partition[p]->stations); curr != NULL;
+         curr = curr->next)
+      sorted[idx++] = curr;
+  }
+
+  for (p = 0; p < RANGE_PARTITIONS; p++) {
+    begin = (unsigned long long)total * p / RANGE_PARTITIONS;
+    end = (unsigned long long)total * (p + 1) / RANGE_PARTITIONS;
+
+    for (idx = begin; idx < end; idx++) {
+      sorted[idx]->prev = idx > begin ? sorted[idx - 1] : NULL;
+      sorted[idx]->next = idx + 1 < end ? sorted[idx + 1] : NULL;
+    }
+
+    highway->lower[p] = p == 0 ? 0 : sorted[begin]->distance;
+    highway->partition[p]->stations =
+        build_station_tree(sorted, begin, end, NULL);
+    highway->partition[p]->stations_number = end - begin;
+  }
+
+  free(sorted);
+
+  return;
+}
+
+void rebalance_all_partitions(struct highway_table_t *table) {
+
+  for (unsigned int i = 0; i < table->dim; i++) {
+    if (table->slot[i] != NULL)
+      rebalance_partitions(table->slot[i]);
+  }
+
+  return;
+}
+
+int main(void) {
+
+  struct worker_t workers[RANGE_PARTITIONS];
+  static struct pending_t pending;
+  struct highway_table_t highways;
+  struct highway_t *highway;
+  struct job_t job;
+  unsigned int commands = 0;
+
+  init_highway_table(&highways);
+  start_workers(workers);
+
+  // Scan every command until EOF or Ctrl-D in terminal
+  while (parse_command(stdin, &job.command)) {
+    highway = get_highway(&highways, job.command.highway);
+
+    if (++commands == REBALANCE_PERIOD) {
+      wait_for_workers(workers, &pending);
+      rebalance_all_partitions(&highways);
+      commands = 0;
+    }
+
+    if (job.command.type == PLAN_ROUTE) {
+      wait_for_workers(workers, &pending);
+      rebalance_partitions(highway);
+      plan_partitioned_route(highway, &job.command, stdout);
+    } else if (job.command.type == PLAN_ROUTES) {
+      wait_for_workers(workers, &pending);
+      rebalance_partitions(highway);
+      plan_partitioned_routes(highway, &job.command, stdout);
+    } else if (job.command.type != UNKNOWN_COMMAND) {
+      unsigned int p = partition_of(highway, job.command.station_distance);
+      job.highway = highway->partition[p];
+      dispatch_job(workers, &pending, &job, p);
+      flush_outputs(workers, &pending);
+    }
+  }
+
+  stop_workers(workers, &pending);
+  remove_all_highways(&highways);
+
+  return 0;
+}
+
+#elif defined(HIGHWAY_SHARDS)
+/*
+Sharded execution: compiling with -DHIGHWAY_SHARDS=<n> -lpthread starts n
+worker threads, and every highway belongs to the worker highway % n.
+ */
+
+int main(void) {
+
+  struct worker_t workers[HIGHWAY_SHARDS];
+  static struct pending_t pending;
+  struct highway_table_t highways;
+  struct job_t job;
+
+  init_highway_table(&highways);
+  start_workers(workers);
+
+  // Scan every command until EOF or Ctrl-D in terminal
+  while (parse_command(stdin, &job.command)) {
+    job.highway = get_highway(&highways, job.command.highway);
+    dispatch_job(workers, &pending, &job,
+                 job.command.highway % HIGHWAY_SHARDS);
+    flush_outputs(workers, &pending);
+  }
+
+  stop_workers(workers, &pending);
+  remove_all_highways(&highways);
+
+  return 0;
+}
+
+#else
+
+int main(void) {
+
+  struct highway_table_t highways;
+  struct command_t commands[COMMAND_BATCH_DIM];
+  unsigned int n;
+
+  init_highway_table(&highways);
+
+  // Scan every command until EOF or Ctrl-D in terminal, reading ahead a
+  // batch of commands at a time
+  do {
+    n = 0;
+    while (n < COMMAND_BATCH_DIM && parse_command(stdin, &commands[n]))
+      n++;
+    execute_batch(&highways, commands, n, stdout);
+  } while (n == COMMAND_BATCH_DIM);
+
+  remove_all_highways(&highways);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,365 @@
+#ifndef H_SORTING_ADAPTIVE
+#define H_SORTING_ADAPTIVE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "algo.h"
+
+/*
+ * Adaptive Sort is one entry point, sort(), that looks at the input and
+ * chooses the algorithm:
+ * - up to insertionMax elements, Insertion Sort
+ * - Counting Sort on the range [min,max] when it is at most countingRatio
+ *   times the length, so we scan the whole array for min and max
+ * - Natural Merge Sort when the array is made of long runs, ascending or
+ *   descending: the estimate is the fraction of descents in
+ *   ADAPTIVE_WINDOWS windows of ADAPTIVE_WINDOW_DIM consecutive elements
+ * - Pattern-defeating Quick Sort when many elements are equal: the estimate
+ *   is the fraction of equal neighbours in a sorted sample of
+ *   ADAPTIVE_SAMPLE_DIM elements
+ * - Radix Sort from radixMin elements, Intro Sort below
+ * The thresholds come from sortTune, that times the algorithms on this
+ * machine around each choice and writes them in a config file, read at the
+ * first sort() from $SORT_CONFIG, or ADAPTIVE_CONFIG; without it we use
+ * the defaults below.
+ */
+
+#define ADAPTIVE_CONFIG "sort.conf"
+#define ADAPTIVE_WINDOWS 32
+#define ADAPTIVE_WINDOW_DIM 16
+#define ADAPTIVE_SAMPLE_DIM 128
+#define ADAPTIVE_COUNTING_MAX (1<<22) //largest range for Counting Sort
+
+struct sortConfig_t {
+    int insertionMax;
+    double countingRatio;
+    double runsMax; //largest fraction of descents (or ascents) for runs
+    double duplicatesMin; //smallest fraction of equal neighbours for pdq
+    int radixMin;
+};
+
+struct sortConfig_t sortConfig = {16,2.0,0.05,0.5,1024};
+
+pthread_once_t sortConfigOnce = PTHREAD_ONCE_INIT;
+
+enum sortChoice_t {
+    SORT_INSERTION,
+    SORT_COUNTING,
+    SORT_RUNS,
+    SORT_DUPLICATES,
+    SORT_RADIX,
+    SORT_INTRO,
+};
+
+char * sortChoiceNames[] = {
+    "Insertion Sort",
+    "Counting Sort",
+    "Natural Merge Sort",
+    "Pattern-defeating Quick Sort",
+    "Radix Sort",
+    "Intro Sort",
+};
+
+// what sort() found out about the input
+struct sortProfile_t {
+    int min;
+    int max;
+    double descents;
+    double duplicates;
+};
+
+// reads the thresholds written by sortSaveConfig, returns 0 if it cannot;
+// missing or unknown keys are left as they are
+int sortLoadConfig(const char * path, struct sortConfig_t * config) {
+    FILE * f = fopen(path,"r");
+    char key[64];
+    double value;
+
+    if(f==NULL) return 0;
+
+    while(fscanf(f,"%63s %lf",key,&value)==2) {
+        // at least 1, so that sortChoose never looks at an empty array
+        if(strcmp(key,"insertion_max")==0) config->insertionMax = value>1 ? value : 1;
+        else if(strcmp(key,"counting_ratio")==0) config->countingRatio = value;
+        else if(strcmp(key,"runs_max")==0) config->runsMax = value;
+        else if(strcmp(key,"duplicates_min")==0) config->duplicatesMin = value;
+        else if(strcmp(key,"radix_min")==0) config->radixMin = value;
+    }
+
+    fclose(f);
+
+    return 1;
+}
+
+int sortSaveConfig(const char * path, struct sortConfig_t * config) {
+    FILE * f = fopen(path,"w");
+
+    if(f==NULL) return 0;
+
+    fprintf(f,"insertion_max %d\n"
+            "counting_ratio %g\n"
+            "runs_max %g\n"
+            "duplicates_min %g\n"
+            "radix_min %d\n",
+            config->insertionMax,config->countingRatio,config->runsMax,
+            config->duplicatesMin,config->radixMin);
+
+    return fclose(f)==0;
+}
+
+void sortLoadDefaultConfig(void) {
+    char * path = getenv("SORT_CONFIG");
+
+    sortLoadConfig(path!=NULL ? path : ADAPTIVE_CONFIG,&sortConfig);
+
+    return;
+}
+
+// fraction of descents in windows spread over the array, 0 when sorted,
+// 1 when reversed; short arrays are scanned all
+double sortDescents(int * a, int n) {
+    long i, w, start, descents = 0, pairs = 0;
+
+    if(n<2) return 0;
+
+    if(n<=ADAPTIVE_WINDOWS*ADAPTIVE_WINDOW_DIM) {
+        for(i=1;i<n;i++) descents += a[i]<a[i-1];
+        return (double)descents/(n-1);
+    }
+
+    for(w=0;w<ADAPTIVE_WINDOWS;w++) {
+        start = (long)(n-ADAPTIVE_WINDOW_DIM)*w/(ADAPTIVE_WINDOWS-1);
+        for(i=start+1;i<start+ADAPTIVE_WINDOW_DIM;i++) descents += a[i]<a[i-1];
+        pairs += ADAPTIVE_WINDOW_DIM-1;
+    }
+
+    return (double)descents/pairs;
+}
+
+// fraction of equal neighbours in a sorted sample of the array
+double sortDuplicates(int * a, int n) {
+    int sample[ADAPTIVE_SAMPLE_DIM];
+    long i, equal = 0;
+
+    // spread with a stride coprime with most periods, not a power of 2
+    for(i=0;i<ADAPTIVE_SAMPLE_DIM;i++) sample[i] = a[(i*2654435761u)%n];
+    introSort(sample,ADAPTIVE_SAMPLE_DIM);
+
+    for(i=1;i<ADAPTIVE_SAMPLE_DIM;i++) equal += sample[i]==sample[i-1];
+
+    return (double)equal/(ADAPTIVE_SAMPLE_DIM-1);
+}
+
+enum sortChoice_t sortChoose(int * a, int n, struct sortConfig_t * config,
+        struct sortProfile_t * profile) {
+    int i, min, max;
+
+    profile->min = profile->max = 0;
+    profile->descents = profile->duplicates = 0;
+
+    if(n<=config->insertionMax) return SORT_INSERTION;
+
+    min = max = a[0];
+    for(i=1;i<n;i++) {
+        min = a[i]<min ? a[i] : min;
+        max = a[i]>max ? a[i] : max;
+    }
+    profile->min = min;
+    profile->max = max;
+    if((int64_t)max-min<ADAPTIVE_COUNTING_MAX && (int64_t)max-min+1<=config->countingRatio*n)
+        return SORT_COUNTING;
+
+    profile->descents = sortDescents(a,n);
+    if(profile->descents<=config->runsMax || profile->descents>=1-config->runsMax)
+        return SORT_RUNS;
+
+    // too short for the sample
+    if(n<ADAPTIVE_SAMPLE_DIM) return SORT_INTRO;
+
+    profile->duplicates = sortDuplicates(a,n);
+    if(profile->duplicates>=config->duplicatesMin) return SORT_DUPLICATES;
+
+    return n>=config->radixMin ? SORT_RADIX : SORT_INTRO;
+}
+
+// Counting Sort of values in [min,min+range)
+void sortCountingRange(int * a, int n, int min, int range) {
+    int i, idx, count;
+    int * frequency = calloc(range,sizeof(int));
+
+    for(i=0;i<n;i++) frequency[a[i]-min]++;
+
+    for(i=0,idx=0;i<range;i++) {
+        for(count=frequency[i];count>0;count--) a[idx++] = min+i;
+    }
+
+    free(frequency);
+
+    return;
+}
+
+void sortWith(int * a, int n, enum sortChoice_t choice, struct sortProfile_t * profile) {
+    switch(choice) {
+        case SORT_INSERTION: insertionSort(a,n); break;
+        case SORT_COUNTING: sortCountingRange(a,n,profile->min,profile->max-profile->min+1); break;
+        case SORT_RUNS: naturalMergeSort(a,n); break;
+        case SORT_DUPLICATES: pdqSort(a,n); break;
+        case SORT_RADIX: radixSort(a,n); break;
+        case SORT_INTRO: introSort(a,n); break;
+    }
+
+    return;
+}
+
+// sorts a with the algorithm that fits it best, and returns which one
+enum sortChoice_t sort(int * a, int n) {
+    struct sortProfile_t profile;
+    enum sortChoice_t choice;
+
+    if(n<2) return SORT_INSERTION;
+
+    pthread_once(&sortConfigOnce,sortLoadDefaultConfig);
+
+    choice = sortChoose(a,n,&sortConfig,&profile);
+    sortWith(a,n,choice,&profile);
+
+    return choice;
+}
+
+/*
+ * Tuning: every threshold is where the algorithm it selects stops being
+ * faster than the one sort() would use otherwise, on inputs made to move
+ * only that characteristic; every time is the best of TUNE_REPEAT runs of
+ * at least TUNE_BATCH elements
+ */
+
+#define TUNE_REPEAT 5
+#define TUNE_BATCH (1<<16)
+#define TUNE_DIM (1<<18) //length of the inputs of the thresholds on data
+
+uint64_t tuneSeed = 0x2545F4914F6CDD1Dull;
+
+int tuneRandom(void) {
+    tuneSeed ^= tuneSeed<<13;
+    tuneSeed ^= tuneSeed>>7;
+    tuneSeed ^= tuneSeed<<17;
+
+    return (int)(tuneSeed>>33);
+}
+
+double tuneNow(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC,&t);
+
+    return t.tv_sec+t.tv_nsec*1e-9;
+}
+
+// best time per array of sorting copies of input with choice
+double tuneTime(int * input, int n, enum sortChoice_t choice, int * work) {
+    struct sortProfile_t profile;
+    int copies = n<TUNE_BATCH ? TUNE_BATCH/n : 1;
+    int r, c;
+    double start, time, best = 1e30;
+
+    for(r=0;r<TUNE_REPEAT;r++) {
+        for(c=0;c<copies;c++) memcpy(&work[c*n],input,sizeof(int)*n);
+        start = tuneNow();
+        for(c=0;c<copies;c++) {
+            // the counting sort needs the range, which sortChoose finds
+            if(choice==SORT_COUNTING) sortChoose(&work[c*n],n,&(struct sortConfig_t){0,1e30,0,2,0},&profile);
+            sortWith(&work[c*n],n,choice,&profile);
+        }
+        time = (tuneNow()-start)/copies;
+        best = time<best ? time : best;
+    }
+
+    return best;
+}
+
+// what sort() would do without the characteristic being tuned
+enum sortChoice_t tuneOtherwise(struct sortConfig_t * config, int n) {
+    return n>=config->radixMin ? SORT_RADIX : SORT_INTRO;
+}
+
+// times the algorithms and fills config with the thresholds of this machine
+void sortTune(struct sortConfig_t * config) {
+    int * input = malloc(sizeof(int)*TUNE_DIM);
+    int * work = malloc(sizeof(int)*(TUNE_DIM>TUNE_BATCH ? TUNE_DIM : TUNE_BATCH));
+    struct sortProfile_t profile;
+    struct sortConfig_t probe = {0,0,0,2,0};
+    int i, n, range, swaps, distinct, x, y, tmp;
+    double ratio;
+
+    // Intro Sort against Insertion Sort on short random arrays
+    config->insertionMax = 1;
+    for(n=2;n<=256;n++) {
+        for(i=0;i<n;i++) input[i] = tuneRandom();
+        if(tuneTime(input,n,SORT_INSERTION,work)>tuneTime(input,n,SORT_INTRO,work)) break;
+        config->insertionMax = n;
+    }
+
+    // Radix Sort against Intro Sort, from the length where radix is faster
+    // at two lengths in a row
+    config->radixMin = TUNE_DIM;
+    for(n=64;n<=TUNE_DIM;n*=2) {
+        for(i=0;i<n;i++) input[i] = tuneRandom();
+        if(tuneTime(input,n,SORT_RADIX,work)<tuneTime(input,n,SORT_INTRO,work)) {
+            for(i=0;i<2*n && 2*n<=TUNE_DIM;i++) input[i] = tuneRandom();
+            if(2*n>TUNE_DIM || tuneTime(input,2*n,SORT_RADIX,work)<tuneTime(input,2*n,SORT_INTRO,work)) {
+                config->radixMin = n;
+                break;
+            }
+        }
+    }
+
+    n = TUNE_DIM;
+
+    // Counting Sort against the others with wider and wider ranges
+    config->countingRatio = 0;
+    for(ratio=1.0/64;ratio*n<ADAPTIVE_COUNTING_MAX;ratio*=2) {
+        range = ratio*n;
+        for(i=0;i<n;i++) input[i] = tuneRandom()%range-range/2;
+        if(tuneTime(input,n,SORT_COUNTING,work)>tuneTime(input,n,tuneOtherwise(config,n),work)) break;
+        config->countingRatio = ratio;
+    }
+
+    // Natural Merge Sort against the others on sorted arrays with more and
+    // more random swaps, the threshold is the estimate sort() would make
+    config->runsMax = 0;
+    for(swaps=1;swaps<=n/4;swaps*=2) {
+        for(i=0;i<n;i++) input[i] = i;
+        for(i=0;i<swaps;i++) {
+            x = tuneRandom()%n;
+            y = tuneRandom()%n;
+            tmp = input[x];
+            input[x] = input[y];
+            input[y] = tmp;
+        }
+        if(tuneTime(input,n,SORT_RUNS,work)>tuneTime(input,n,tuneOtherwise(config,n),work)) break;
+        config->runsMax = sortDescents(input,n);
+    }
+
+    // Pattern-defeating Quick Sort against the others with fewer and fewer
+    // distinct values, spread over all the ints so Counting Sort is out
+    config->duplicatesMin = 2;
+    for(distinct=n/4;distinct>=2;distinct/=4) {
+        for(i=0;i<n;i++) input[i] = (tuneRandom()%distinct)*(INT_MAX/distinct);
+        if(tuneTime(input,n,SORT_DUPLICATES,work)<tuneTime(input,n,tuneOtherwise(config,n),work)) {
+            sortChoose(input,n,&probe,&profile);
+            config->duplicatesMin = profile.duplicates;
+            break;
+        }
+    }
+
+    free(input);
+    free(work);
+
+    return;
+}
+
+#endif
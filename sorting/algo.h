@@ -2,8 +2,11 @@
 #define H_SORTING_ALGO
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <limits.h>
 #include "common.h"
+#include "simd.h"
 
 /*
  * Bubble Sort is very simple, but not very time efficient:
@@ -98,6 +101,375 @@ void mergeSort(int * a, int n) {
     return;
 }
 
+/*
+ * Natural Merge Sort is Merge Sort that exploits the order already in
+ * the array, like TimSort:
+ * - Time complexity: $O(n\log(r))$ with r the number of runs already
+ *   sorted in the array, so $O(n)$ on sorted and reversed arrays
+ * - Space complexity: $O(n)$, allocated once
+ * - Stability: Yes, descending runs are reversed only if strictly descending
+ *   and in a merge we take from the right only when strictly smaller; the
+ *   sorting network of the short runs is not, but equal ints are the same
+ * - Optimizations: we find the ascending and descending runs, and extend the
+ *   short ones with the SIMD sorting network; runs are merged bottom-up
+ *   alternating the array and one scratch buffer as source and destination,
+ *   so every level moves each element once and there are no sentinels; the
+ *   merge loop is branchless, and when one run wins MIN_GALLOP times in a
+ *   row we switch to exponential search to copy its elements in bulk
+ */
+
+#define MIN_GALLOP 7
+
+// number of elements of sorted a[0..n) smaller than key (left) or not
+// greater than key (right), found with exponential search and then binary
+// search, so it takes $O(\log(k))$ to skip k elements
+int gallop(int key, int * a, int n, int right) {
+    int low = 0, high = 1, mid;
+
+    while(high<n && (right ? a[high-1]<=key : a[high-1]<key)) {
+        low = high;
+        high = 2*high+1;
+    }
+    if(high>n) high = n;
+
+    // the answer is in [low,high]
+    while(low<high) {
+        mid = low+(high-low)/2;
+        if(right ? a[mid]<=key : a[mid]<key) low = mid+1;
+        else high = mid;
+    }
+
+    return low;
+}
+
+// merges the sorted runs src[lo..mid) and src[mid..hi) in dst[lo..hi)
+void mergeRuns(int * src, int lo, int mid, int hi, int * dst) {
+    int i = lo, j = mid, k = lo, takeRight, winsL = 0, winsR = 0, c;
+
+    // left elements not greater than the first right one are already in
+    // place, as the right elements greater than the last left one
+    c = gallop(src[mid],&src[lo],mid-lo,1);
+    memcpy(&dst[lo],&src[lo],sizeof(int)*c);
+    i += c;
+    k += c;
+    c = hi-mid-gallop(src[mid-1],&src[mid],hi-mid,1);
+    memcpy(&dst[hi-c],&src[hi-c],sizeof(int)*c);
+    hi -= c;
+
+    while(i<mid && j<hi) {
+        takeRight = src[j]<src[i];
+        dst[k++] = takeRight ? src[j] : src[i];
+        j += takeRight;
+        i += 1-takeRight;
+        winsR = (winsR+1) & -takeRight;
+        winsL = (winsL+1) & -(1-takeRight);
+
+        if((winsL|winsR)>=MIN_GALLOP && i<mid && j<hi) {
+            if(winsR) c = gallop(src[i],&src[j],hi-j,0);
+            else c = gallop(src[j],&src[i],mid-i,1);
+            if(winsR) {
+                memcpy(&dst[k],&src[j],sizeof(int)*c);
+                j += c;
+            }
+            else {
+                memcpy(&dst[k],&src[i],sizeof(int)*c);
+                i += c;
+            }
+            k += c;
+            winsL = winsR = 0;
+        }
+    }
+
+    memcpy(&dst[k],&src[i],sizeof(int)*(mid-i));
+    k += mid-i;
+    memcpy(&dst[k],&src[j],sizeof(int)*(hi-j));
+
+    return;
+}
+
+// TimSort minimum run length, between 32 and 64, chosen so that n/minRun is
+// a power of 2 or slightly less, which keeps the merges balanced
+int minRunLength(int n) {
+    int r = 0;
+
+    while(n>=64) {
+        r |= n&1;
+        n >>= 1;
+    }
+
+    return n+r;
+}
+
+void naturalMergeSort(int * a, int n) {
+    int minRun, len, start, end, numRuns, p, q, i, tmp;
+    int * buffer, * runs, * src, * dst, * swp;
+
+    if(n<2) return;
+
+    minRun = minRunLength(n);
+
+    // one allocation for the scratch buffer and the run boundaries
+    buffer = malloc(sizeof(int)*((size_t)n+n/minRun+2));
+    runs = &buffer[n];
+
+    numRuns = 0;
+    start = 0;
+    while(start<n) {
+        end = start+1;
+        if(end<n && a[end]<a[start]) {
+            while(end<n && a[end]<a[end-1]) end++;
+            for(i=start;i<start+(end-start)/2;i++) {
+                tmp = a[i];
+                a[i] = a[end-1-(i-start)];
+                a[end-1-(i-start)] = tmp;
+            }
+        }
+        else {
+            while(end<n && a[end]>=a[end-1]) end++;
+        }
+
+        len = end-start;
+        if(len<minRun) {
+            len = n-start<minRun ? n-start : minRun;
+            simdSortSmall(&a[start],len);
+            end = start+len;
+        }
+
+        runs[numRuns++] = start;
+        start = end;
+    }
+    runs[numRuns] = n;
+
+    src = a;
+    dst = buffer;
+    while(numRuns>1) {
+        for(p=0,q=0;p+1<numRuns;p+=2,q++) {
+            mergeRuns(src,runs[p],runs[p+1],runs[p+2],dst);
+            runs[q] = runs[p];
+        }
+        if(p<numRuns) {
+            memcpy(&dst[runs[p]],&src[runs[p]],sizeof(int)*(n-runs[p]));
+            runs[q++] = runs[p];
+        }
+        runs[q] = n;
+        numRuns = q;
+
+        swp = src;
+        src = dst;
+        dst = swp;
+    }
+
+    if(src!=a) memcpy(a,src,sizeof(int)*n);
+
+    free(buffer);
+
+    return;
+}
+
+/*
+ * Block Merge Sort is a stable Merge Sort for when Merge Sort would double
+ * the memory, like GrailSort with an external buffer:
+ * - Time complexity: $O(n\log(n))$
+ * - Space complexity: $O(\sqrt{n})$, a buffer of one block of about
+ *   $\sqrt{n}$ elements and two tags per block
+ * - Stability: Yes, in every merge the left run wins ties, also when the
+ *   blocks are put in order; the sorting network of the short runs is not,
+ *   but equal ints are the same
+ * - Optimizations: short runs are sorted with the SIMD sorting network
+ *   and merged bottom-up, skipping the merges of runs already in order;
+ *   when one run fits the buffer it is merged through it; otherwise both
+ *   runs are cut in blocks, which are put in order of their first element
+ *   with one move each, following the cycles of the permutation, and then
+ *   every block only has to be merged with what is left of the blocks of
+ *   the other run before it, which is less than a block and fits the
+ *   buffer
+ */
+
+#define BLOCK_MERGE_RUN SIMD_SMALL_DIM
+
+void reverseInts(int * a, int n) {
+    int i, tmp;
+
+    for(i=0;i<n/2;i++) {
+        tmp = a[i];
+        a[i] = a[n-1-i];
+        a[n-1-i] = tmp;
+    }
+
+    return;
+}
+
+// merges buf[0..nl), the left run, with r[0..nr) in out, which is at most
+// nl elements before r, until one of them ends, the left winning ties if
+// leftWins; returns how many elements of buf it took, in *takenR of r
+int blockMergeForward(int * buf, int nl, int * r, int nr, int * out, int leftWins, int * takenR) {
+    int i = 0, j = 0, takeRight;
+
+    // one loop for each tie rule, so the compare stays branchless
+    if(leftWins) {
+        while(i<nl && j<nr) {
+            takeRight = r[j]<buf[i];
+            *out++ = takeRight ? r[j] : buf[i];
+            j += takeRight;
+            i += 1-takeRight;
+        }
+    }
+    else {
+        while(i<nl && j<nr) {
+            takeRight = r[j]<=buf[i];
+            *out++ = takeRight ? r[j] : buf[i];
+            j += takeRight;
+            i += 1-takeRight;
+        }
+    }
+    *takenR = j;
+
+    return i;
+}
+
+// merges the sorted a[0..na) and a[na..na+nb), with buf of s elements and
+// tags for two ints per block
+void blockMerge(int * a, int na, int nb, int * buf, int s, int * tags) {
+    int i, j, k, t, cur, src, a0, blocks, tail, after, pos, len, origin, next, nextOrigin;
+    int * order = tags, * originOf = &tags[(na+nb)/s];
+    int * first;
+
+    if(a[na-1]<=a[na]) return;
+
+    // the whole right run goes first, as in reversed arrays
+    if(a[na+nb-1]<a[0]) {
+        reverseInts(a,na);
+        reverseInts(&a[na],nb);
+        reverseInts(a,na+nb);
+        return;
+    }
+
+    if(na<=s) {
+        memcpy(buf,a,sizeof(int)*na);
+        i = blockMergeForward(buf,na,&a[na],nb,a,1,&j);
+        memcpy(&a[i+j],&buf[i],sizeof(int)*(na-i));
+        return;
+    }
+
+    if(nb<=s) {
+        memcpy(buf,&a[na],sizeof(int)*nb);
+        i = na-1;
+        j = nb-1;
+        k = na+nb-1;
+        while(i>=0 && j>=0) {
+            t = a[i]>buf[j];
+            a[k--] = t ? a[i] : buf[j];
+            i -= t;
+            j -= 1-t;
+        }
+        memcpy(a,buf,sizeof(int)*(j+1));
+        return;
+    }
+
+    // the first na%s elements of the left run stay in front, the last
+    // nb%s of the right one are the tail
+    a0 = na%s;
+    first = &a[a0];
+    k = na/s;
+    blocks = k+nb/s;
+    tail = nb%s;
+
+    // the order of the blocks by first element is a merge of the two runs
+    for(i=0,j=k,t=0;t<blocks;t++) {
+        if(j==blocks || (i<k && first[i*s]<=first[j*s])) order[t] = i++;
+        else order[t] = j++;
+        originOf[t] = order[t]>=k;
+    }
+
+    // slot t takes block order[t], the cycles go through the buffer
+    for(t=0;t<blocks;t++) {
+        if(order[t]<0 || order[t]==t) continue;
+        memcpy(buf,&first[t*s],sizeof(int)*s);
+        for(cur=t;(src = order[cur])!=t;cur=src) {
+            memcpy(&first[cur*s],&first[src*s],sizeof(int)*s);
+            order[cur] = -1;
+        }
+        memcpy(&first[cur*s],buf,sizeof(int)*s);
+        order[cur] = -1;
+    }
+
+    // the left blocks that start after the tail go after it
+    after = 0;
+    if(tail>0) {
+        while(after<blocks && !originOf[blocks-1-after] && first[(blocks-1-after)*s]>a[na+nb-tail])
+            after++;
+        memcpy(buf,&a[na+nb-tail],sizeof(int)*tail);
+        memmove(&first[(blocks-after)*s+tail],&first[(blocks-after)*s],sizeof(int)*after*s);
+        memcpy(&first[(blocks-after)*s],buf,sizeof(int)*tail);
+    }
+
+    // what is left of the current run, at pos, is merged with the next
+    // segment only if it comes from the other run
+    pos = 0;
+    len = a0;
+    origin = 0;
+    for(t=0;t<=blocks;t++) {
+        if(t<blocks-after) {
+            next = s;
+            nextOrigin = originOf[t];
+        }
+        else if(t==blocks-after) {
+            next = tail;
+            nextOrigin = 1;
+        }
+        else {
+            next = s;
+            nextOrigin = 0;
+        }
+
+        if(len==0 || nextOrigin==origin) {
+            pos += len;
+            len = next;
+            origin = nextOrigin;
+            continue;
+        }
+
+        memcpy(buf,&a[pos],sizeof(int)*len);
+        i = blockMergeForward(buf,len,&a[pos+len],next,&a[pos],origin==0,&j);
+        if(i==len) {
+            pos += len+j;
+            len = next-j;
+            origin = nextOrigin;
+        }
+        else {
+            memcpy(&a[pos+i+j],&buf[i],sizeof(int)*(len-i));
+            pos += i+j;
+            len -= i;
+        }
+    }
+
+    return;
+}
+
+void blockMergeSort(int * a, int n) {
+    int s, * buf, * tags;
+    long lo, width;
+
+    if(n<2) return;
+
+    // blocks of a power of 2 between $\sqrt{n}$ and $2\sqrt{n}$
+    for(s=BLOCK_MERGE_RUN;(long)s*s<n;s<<=1);
+    buf = malloc(sizeof(int)*s);
+    tags = malloc(sizeof(int)*2*(n/s+1));
+
+    for(lo=0;lo<n;lo+=BLOCK_MERGE_RUN)
+        simdSortSmall(&a[lo],n-lo<BLOCK_MERGE_RUN ? n-lo : BLOCK_MERGE_RUN);
+
+    for(width=BLOCK_MERGE_RUN;width<n;width*=2)
+        for(lo=0;lo+width<n;lo+=2*width)
+            blockMerge(&a[lo],width,lo+2*width<=n ? width : n-lo-width,buf,s,tags);
+
+    free(buf);
+    free(tags);
+
+    return;
+}
+
 int partition(int * a, int n) {
 
     int pivot = a[0];
@@ -141,7 +513,447 @@ void quickSort(int * a, int n) {
     return;
 }
 
+/*
+ * Heap Sort builds a max heap in the array, then moves the maximum
+ * to the end one at a time:
+ * - Time complexity: $O(n\log(n))$ in every case
+ * - Space complexity: $O(1)$
+ * - Stability: No
+ * - Optimizations: the heap is 4-ary, so it is half as deep, and it starts
+ *   at the element that puts the four children of every node in the same
+ *   16 bytes, and so in the same cache line; the largest child is chosen
+ *   with branchless comparisons, while the grandchildren are prefetched,
+ *   and the sift down is bottom-up (Floyd): the hole goes down to a leaf
+ *   without comparing with the element to place, which then goes up from
+ *   there, usually only a few levels
+ */
+
+// sifts down h[i] in the 4-ary heap h[0..n), whose children of node i are
+// h[4i+1..4i+4]; the indexes are long, since 4i+1 and the prefetched
+// grandchildren overflow an int on arrays of more than 2^29 elements
+void siftDown(int * h, int n, int i0) {
+    long i = i0, start = i0, child, best, other, parent, mask;
+    int tmp = h[i], x, y;
+
+    while((child = 4*i+1)+3 < n) {
+        // the 16 grandchildren are contiguous, so they can be loaded while
+        // choosing among the children
+        __builtin_prefetch(&h[4*child+1]);
+        __builtin_prefetch(&h[4*child+16]);
+        best = child + (h[child+1]>h[child]);
+        other = child+2 + (h[child+3]>h[child+2]);
+        x = h[best];
+        y = h[other];
+        // selected with a mask, or the compiler may emit a branch
+        mask = -(long)(y>x);
+        h[i] = x^((x^y)&mask);
+        i = best^((best^other)&mask);
+    }
+    if(child<n) {
+        best = child;
+        for(other=child+1;other<n;other++) best = h[other]>h[best] ? other : best;
+        h[i] = h[best];
+        i = best;
+    }
+
+    while(i>start && h[parent = (i-1)/4]<tmp) {
+        h[i] = h[parent];
+        i = parent;
+    }
+    h[i] = tmp;
+
+    return;
+}
+
 void heapSort(int * a, int n) {
+    int skip, m, i, tmp, low, high, mid, * h;
+
+    // the first skip elements are left out of the heap, so that the children
+    // of the root, at h+1, are 16 bytes aligned
+    skip = (3-(int)(((uintptr_t)a/sizeof(int))&3))&3;
+    if(skip>n) skip = n;
+    h = &a[skip];
+    m = n-skip;
+
+    for(i=m>1 ? (m-2)/4 : -1;i>=0;i--) siftDown(h,m,i);
+
+    for(i=m-1;i>0;i--) {
+        tmp = h[0];
+        h[0] = h[i];
+        h[i] = tmp;
+        siftDown(h,i,0);
+    }
+
+    // then each of them is moved to its place in the sorted part
+    for(i=skip-1;i>=0;i--) {
+        tmp = a[i];
+        low = i+1;
+        high = n;
+        while(low<high) {
+            mid = low+(high-low)/2;
+            if(a[mid]<tmp) low = mid+1;
+            else high = mid;
+        }
+        memmove(&a[i],&a[i+1],sizeof(int)*(low-i-1));
+        a[low-1] = tmp;
+    }
+
+    return;
+}
+
+// sorts three elements in place with at most three swaps
+void sort3(int * x, int * y, int * z) {
+    int tmp;
+
+    if(*y<*x) { tmp = *x; *x = *y; *y = tmp; }
+    if(*z<*y) { tmp = *y; *y = *z; *z = tmp; }
+    if(*y<*x) { tmp = *x; *x = *y; *y = tmp; }
+
+    return;
+}
+
+/*
+ * Intro Sort is Quick Sort made robust against bad inputs:
+ * - Time complexity: $O(n\log(n))$ also in the worst case
+ * - Space complexity: $O(\log(n))$
+ * - Stability: No
+ * - Optimizations: pivot is the median of 3, or of 3 medians of 3
+ *   (ninther) on long arrays, so sorted and reversed arrays are split in half;
+ *   we recurse only on the smaller side and loop on the bigger one,
+ *   so the stack never exceeds $\log(n)$ frames; partitions shorter than
+ *   INTRO_THRESHOLD are sorted with the SIMD sorting network; after
+ *   $2\log(n)$ levels we switch to Heap Sort to bound the time
+ */
+
+#define INTRO_THRESHOLD SIMD_SMALL_DIM
+#define NINTHER_THRESHOLD 128
+
+// moves a good pivot in a[0] for partition()
+void choosePivot(int * a, int n) {
+    int s = n/2, tmp;
+
+    if(n>NINTHER_THRESHOLD) {
+        sort3(&a[0],&a[s],&a[n-1]);
+        sort3(&a[1],&a[s-1],&a[n-2]);
+        sort3(&a[2],&a[s+1],&a[n-3]);
+        sort3(&a[s-1],&a[s],&a[s+1]);
+    }
+    else sort3(&a[0],&a[s],&a[n-1]);
+
+    tmp = a[0];
+    a[0] = a[s];
+    a[s] = tmp;
+
+    return;
+}
+
+void introSortLoop(int * a, int n, int depth) {
+    int pivot;
+
+    while(1) {
+        if(n<=INTRO_THRESHOLD) {
+            simdSortSmall(a,n);
+            return;
+        }
+        if(depth==0) {
+            heapSort(a,n);
+            return;
+        }
+        depth--;
+
+        choosePivot(a,n);
+        pivot = partition(a,n);
+
+        if(pivot+1 < n-pivot-1) {
+            introSortLoop(a,pivot+1,depth);
+            a = &a[pivot+1];
+            n = n-pivot-1;
+        }
+        else {
+            introSortLoop(&a[pivot+1],n-pivot-1,depth);
+            n = pivot+1;
+        }
+    }
+
+    return;
+}
+
+void introSort(int * a, int n) {
+    int depth = 0;
+
+    for(int i=n;i>1;i>>=1) depth += 2;
+
+    introSortLoop(a,n,depth);
+
+    return;
+}
+
+/*
+ * Pattern-defeating Quick Sort (pdqsort, by Orson Peters) is Intro Sort
+ * with some more tricks:
+ * - Time complexity: $O(n\log(n))$ in the worst case, $O(n)$ on sorted,
+ *   reversed and few unique values arrays
+ * - Space complexity: $O(\log(n))$
+ * - Stability: No
+ * - Optimizations: partition is branchless, we first collect in two blocks
+ *   of PDQ_BLOCK offsets the elements on the wrong side, without any
+ *   branch depending on the data, then swap them; if the pivot is equal to
+ *   the element before the partition, which is the pivot of a previous
+ *   step, all equal elements are put on the left and never sorted again;
+ *   unbalanced partitions shuffle some elements to break patterns, and
+ *   after $\log(n)$ of them we switch to Heap Sort; partitions that were
+ *   already in order are finished with an Insertion Sort that gives up
+ *   after a few moves, and short ones are sorted with the SIMD sorting
+ *   network
+ */
+
+#define PDQ_SMALL_THRESHOLD 32
+#define PDQ_PARTIAL_INSERTION_LIMIT 8
+#define PDQ_BLOCK 64
+
+void swapInt(int * x, int * y) {
+    int tmp = *x;
+    *x = *y;
+    *y = tmp;
+
+    return;
+}
+
+// Insertion Sort that returns 0 as soon as it moved more than
+// PDQ_PARTIAL_INSERTION_LIMIT elements, 1 if it sorted [begin,end)
+int partialInsertionSort(int * begin, int * end) {
+    int * cur, * sift, tmp, moved = 0;
+
+    for(cur=begin+1;cur<end;cur++) {
+        if(*cur<cur[-1]) {
+            tmp = *cur;
+            sift = cur;
+            do {
+                *sift = sift[-1];
+                sift--;
+            } while(sift!=begin && tmp<sift[-1]);
+            *sift = tmp;
+            moved += cur-sift;
+            if(moved>PDQ_PARTIAL_INSERTION_LIMIT) return 0;
+        }
+    }
+
+    return 1;
+}
+
+// swaps num pairs of elements given by offsets from first and last,
+// with a cyclic permutation when we do not need to keep their order
+void swapOffsets(int * first, int * last, unsigned char * offsetsL,
+                 unsigned char * offsetsR, int num, int useSwaps) {
+    int i, tmp, * l, * r;
+
+    if(useSwaps) {
+        for(i=0;i<num;i++) swapInt(first+offsetsL[i], last-offsetsR[i]);
+    }
+    else if(num>0) {
+        l = first+offsetsL[0];
+        r = last-offsetsR[0];
+        tmp = *l;
+        *l = *r;
+        for(i=1;i<num;i++) {
+            l = first+offsetsL[i];
+            *r = *l;
+            r = last-offsetsR[i];
+            *l = *r;
+        }
+        *r = tmp;
+    }
+
+    return;
+}
+
+// partitions [begin,end) around *begin, elements equal to the pivot go on
+// the right. Returns the final position of the pivot, *alreadyPartitioned
+// is set if no element had to be moved
+int * partitionRightBranchless(int * begin, int * end, int * alreadyPartitioned) {
+    int pivot = *begin;
+    int * first = begin, * last = end, * baseL, * baseR, * pivotPos;
+    unsigned char offsetsL[PDQ_BLOCK], offsetsR[PDQ_BLOCK];
+    int numL = 0, numR = 0, startL = 0, startR = 0, num, i;
+    int unknown, splitL, splitR;
+
+    // the median of 3 guarantees there is an element not smaller than the
+    // pivot on the right
+    while(*++first<pivot);
+
+    if(first-1==begin) while(first<last && !(*--last<pivot));
+    else while(!(*--last<pivot));
+
+    *alreadyPartitioned = first>=last;
+
+    if(!*alreadyPartitioned) {
+        swapInt(first,last);
+        first++;
+
+        baseL = first;
+        baseR = last;
+
+        while(first<last) {
+            // we fill with the wrong side elements the blocks that are empty,
+            // splitting the unknown elements if both of them are
+            unknown = last-first;
+            splitL = numL==0 ? (numR==0 ? unknown/2 : unknown) : 0;
+            splitR = numR==0 ? unknown-splitL : 0;
+            if(splitL>PDQ_BLOCK) splitL = PDQ_BLOCK;
+            if(splitR>PDQ_BLOCK) splitR = PDQ_BLOCK;
+
+            for(i=0;i<splitL;i++) {
+                offsetsL[numL] = i;
+                numL += !(*first<pivot);
+                first++;
+            }
+            for(i=0;i<splitR;) {
+                offsetsR[numR] = ++i;
+                numR += *--last<pivot;
+            }
+
+            num = numL<numR ? numL : numR;
+            swapOffsets(baseL,baseR,offsetsL+startL,offsetsR+startR,num,numL==numR);
+            numL -= num;
+            numR -= num;
+            startL += num;
+            startR += num;
+
+            if(numL==0) {
+                startL = 0;
+                baseL = first;
+            }
+            if(numR==0) {
+                startR = 0;
+                baseR = last;
+            }
+        }
+
+        // only one of the two blocks can still have wrong side elements,
+        // they go to the border between the two sides
+        if(numL) {
+            while(numL--) swapInt(baseL+offsetsL[startL+numL], --last);
+            first = last;
+        }
+        if(numR) {
+            while(numR--) {
+                swapInt(baseR-offsetsR[startR+numR], first);
+                first++;
+            }
+            last = first;
+        }
+    }
+
+    pivotPos = first-1;
+    *begin = *pivotPos;
+    *pivotPos = pivot;
+
+    return pivotPos;
+}
+
+// partitions [begin,end) around *begin, elements equal to the pivot go on
+// the left. Used when we know that no element is smaller than the pivot
+int * partitionLeft(int * begin, int * end) {
+    int pivot = *begin;
+    int * first = begin, * last = end;
+
+    while(pivot<*--last);
+
+    if(last+1==end) while(first<last && !(pivot<*++first));
+    else while(!(pivot<*++first));
+
+    while(first<last) {
+        swapInt(first,last);
+        while(pivot<*--last);
+        while(!(pivot<*++first));
+    }
+
+    *begin = *last;
+    *last = pivot;
+
+    return last;
+}
+
+void pdqSortLoop(int * begin, int * end, int badAllowed, int leftmost) {
+    int size, s, lSize, rSize, alreadyPartitioned;
+    int * pivotPos;
+
+    while(1) {
+        size = end-begin;
+
+        if(size<=PDQ_SMALL_THRESHOLD) {
+            simdSortSmall(begin,size);
+            return;
+        }
+
+        s = size/2;
+        if(size>NINTHER_THRESHOLD) {
+            sort3(begin,begin+s,end-1);
+            sort3(begin+1,begin+s-1,end-2);
+            sort3(begin+2,begin+s+1,end-3);
+            sort3(begin+s-1,begin+s,begin+s+1);
+            swapInt(begin,begin+s);
+        }
+        else sort3(begin+s,begin,end-1);
+
+        // begin[-1] is the pivot of a previous partition, so no element
+        // here is smaller: if it is equal to our pivot, all the elements
+        // equal to it go on the left, and they are already in place
+        if(!leftmost && !(begin[-1]<*begin)) {
+            begin = partitionLeft(begin,end)+1;
+            continue;
+        }
+
+        pivotPos = partitionRightBranchless(begin,end,&alreadyPartitioned);
+
+        lSize = pivotPos-begin;
+        rSize = end-(pivotPos+1);
+
+        if(lSize<size/8 || rSize<size/8) {
+            if(--badAllowed==0) {
+                heapSort(begin,size);
+                return;
+            }
+
+            if(lSize>=PDQ_SMALL_THRESHOLD) {
+                swapInt(begin,begin+lSize/4);
+                swapInt(pivotPos-1,pivotPos-lSize/4);
+                if(lSize>NINTHER_THRESHOLD) {
+                    swapInt(begin+1,begin+(lSize/4+1));
+                    swapInt(begin+2,begin+(lSize/4+2));
+                    swapInt(pivotPos-2,pivotPos-(lSize/4+1));
+                    swapInt(pivotPos-3,pivotPos-(lSize/4+2));
+                }
+            }
+            if(rSize>=PDQ_SMALL_THRESHOLD) {
+                swapInt(pivotPos+1,pivotPos+(1+rSize/4));
+                swapInt(end-1,end-rSize/4);
+                if(rSize>NINTHER_THRESHOLD) {
+                    swapInt(pivotPos+2,pivotPos+(2+rSize/4));
+                    swapInt(pivotPos+3,pivotPos+(3+rSize/4));
+                    swapInt(end-2,end-(1+rSize/4));
+                    swapInt(end-3,end-(2+rSize/4));
+                }
+            }
+        }
+        else if(alreadyPartitioned && partialInsertionSort(begin,pivotPos)
+                && partialInsertionSort(pivotPos+1,end)) return;
+
+        // the left side is at most $\log(n)$ levels deep, thanks to
+        // the Heap Sort fallback, so we recurse on it and loop on the right
+        pdqSortLoop(begin,pivotPos,badAllowed,leftmost);
+        begin = pivotPos+1;
+        leftmost = 0;
+    }
+}
+
+void pdqSort(int * a, int n) {
+    int badAllowed = 0;
+
+    for(int i=n;i>1;i>>=1) badAllowed++;
+
+    pdqSortLoop(a,a+n,badAllowed,1);
+
     return;
 }
 
@@ -165,6 +977,8 @@ void countingSort(int * a, int n, int domain_size) {
             idx++;
         }
     }
+
+    free(frequency);
     
     return;
 }
@@ -197,11 +1011,227 @@ void countingStableSort(int * a, int n, int domain_size) {
         a[idx] = b[i];
         cumulative[b[i]]--;
     }
+
+    free(frequency);
+    free(cumulative);
+    free(b);
     
     return;
 }
 
+/*
+ * Radix Sort (LSD) sorts by one digit of RADIX_BITS bits at a time, from the
+ * least significant, with a stable counting sort:
+ * - Time complexity: $O(n\cdot32/RADIX\_BITS)$, so 3 passes on 32 bit keys
+ * - Space complexity: $O(n)$
+ * - Stability: Yes
+ * - Optimizations: the sign bit is flipped so that negative numbers come
+ *   first; the histograms of all the digits are built in a single pass, and
+ *   the digits where every key has the same value are skipped; the passes
+ *   alternate the array and the buffer, so there is at most one final copy
+ */
 
+#define RADIX_BITS 11
+#define RADIX_SIZE (1<<RADIX_BITS)
+#define RADIX_DIGITS ((32+RADIX_BITS-1)/RADIX_BITS)
 
-#endif
+// key with the same order as signed int, but as unsigned
+#define RADIX_KEY(x) ((unsigned int)(x)^0x80000000u)
+
+// Radix Sort with a buffer as big as a given by the caller, and lengths and
+// counters of 64 bits, so it can sort more than 2^31 keys
+void radixSortBuffer(int * a, long n, int * b) {
+    long i, idx, sum, count;
+    int d, shift;
+    int * src, * dst, * swp;
+    unsigned int key;
+    long (* frequency)[RADIX_SIZE];
+
+    if(n<2) return;
+
+    frequency = calloc(RADIX_DIGITS,sizeof(*frequency));
+
+    for(i=0;i<n;i++) {
+        key = RADIX_KEY(a[i]);
+        for(d=0;d<RADIX_DIGITS;d++) frequency[d][(key>>(d*RADIX_BITS))&(RADIX_SIZE-1)]++;
+    }
+
+    src = a;
+    dst = b;
+    for(d=0;d<RADIX_DIGITS;d++) {
+        shift = d*RADIX_BITS;
+
+        // all the keys have the same digit, so this pass would not move them
+        if(frequency[d][(RADIX_KEY(src[0])>>shift)&(RADIX_SIZE-1)]==n) continue;
+
+        sum = 0;
+        for(i=0;i<RADIX_SIZE;i++) {
+            count = frequency[d][i];
+            frequency[d][i] = sum;
+            sum += count;
+        }
+
+        for(i=0;i<n;i++) {
+            idx = frequency[d][(RADIX_KEY(src[i])>>shift)&(RADIX_SIZE-1)]++;
+            dst[idx] = src[i];
+        }
+
+        swp = src;
+        src = dst;
+        dst = swp;
+    }
+
+    if(src!=a) memcpy(a,src,n*sizeof(int));
+
+    free(frequency);
+
+    return;
+}
 
+void radixSort(int * a, int n) {
+    int * b;
+
+    if(n<2) return;
+
+    b = malloc(n*sizeof(int));
+    radixSortBuffer(a,n,b);
+    free(b);
+
+    return;
+}
+
+// Radix Sort on 64 bit keys, with the same digits: 6 passes at most
+#define RADIX_DIGITS64 ((64+RADIX_BITS-1)/RADIX_BITS)
+
+#define RADIX_KEY64(x) ((uint64_t)(x)^0x8000000000000000ull)
+
+void radixSort64Buffer(int64_t * a, long n, int64_t * b) {
+    long i, idx, sum, count;
+    int d, shift;
+    int64_t * src, * dst, * swp;
+    uint64_t key;
+    long (* frequency)[RADIX_SIZE];
+
+    if(n<2) return;
+
+    frequency = calloc(RADIX_DIGITS64,sizeof(*frequency));
+
+    for(i=0;i<n;i++) {
+        key = RADIX_KEY64(a[i]);
+        for(d=0;d<RADIX_DIGITS64;d++) frequency[d][(key>>(d*RADIX_BITS))&(RADIX_SIZE-1)]++;
+    }
+
+    src = a;
+    dst = b;
+    for(d=0;d<RADIX_DIGITS64;d++) {
+        shift = d*RADIX_BITS;
+
+        if(frequency[d][(RADIX_KEY64(src[0])>>shift)&(RADIX_SIZE-1)]==n) continue;
+
+        sum = 0;
+        for(i=0;i<RADIX_SIZE;i++) {
+            count = frequency[d][i];
+            frequency[d][i] = sum;
+            sum += count;
+        }
+
+        for(i=0;i<n;i++) {
+            idx = frequency[d][(RADIX_KEY64(src[i])>>shift)&(RADIX_SIZE-1)]++;
+            dst[idx] = src[i];
+        }
+
+        swp = src;
+        src = dst;
+        dst = swp;
+    }
+
+    if(src!=a) memcpy(a,src,n*sizeof(int64_t));
+
+    free(frequency);
+
+    return;
+}
+
+void radixSort64(int64_t * a, long n) {
+    int64_t * b;
+
+    if(n<2) return;
+
+    b = malloc(n*sizeof(int64_t));
+    radixSort64Buffer(a,n,b);
+    free(b);
+
+    return;
+}
+
+/*
+ * American Flag Sort is Radix Sort (MSD) in place: it puts every key in the
+ * bucket of its most significant byte swapping along permutation cycles, and
+ * then sorts each bucket on the next byte:
+ * - Time complexity: $O(4n)$
+ * - Space complexity: $O(1)$, 4 levels of recursion with 256 counters each
+ * - Stability: No
+ * - Optimizations: bytes where every key falls in the same bucket are
+ *   skipped without moving anything, and small buckets are sorted with
+ *   Insertion Sort
+ */
+
+#define FLAG_THRESHOLD 64
+
+void americanFlagSortLoop(int * a, int n, int shift) {
+    int i, b, d, sum, tmp;
+    int count[256], head[256], tail[256];
+
+    if(n<=FLAG_THRESHOLD) {
+        insertionSort(a,n);
+        return;
+    }
+
+    for(i=0;i<256;i++) count[i] = 0;
+    for(i=0;i<n;i++) count[(RADIX_KEY(a[i])>>shift)&255]++;
+
+    // all the keys have the same byte, go to the next one
+    if(count[(RADIX_KEY(a[0])>>shift)&255]==n) {
+        if(shift>0) americanFlagSortLoop(a,n,shift-8);
+        return;
+    }
+
+    sum = 0;
+    for(i=0;i<256;i++) {
+        head[i] = sum;
+        sum += count[i];
+        tail[i] = sum;
+    }
+
+    for(b=0;b<256;b++) {
+        while(head[b]<tail[b]) {
+            tmp = a[head[b]];
+            d = (RADIX_KEY(tmp)>>shift)&255;
+            // follow the cycle until an element of bucket b comes back
+            while(d!=b) {
+                i = a[head[d]];
+                a[head[d]++] = tmp;
+                tmp = i;
+                d = (RADIX_KEY(tmp)>>shift)&255;
+            }
+            a[head[b]++] = tmp;
+        }
+    }
+
+    if(shift==0) return;
+
+    for(b=0,sum=0;b<256;b++) {
+        if(count[b]>1) americanFlagSortLoop(&a[sum],count[b],shift-8);
+        sum += count[b];
+    }
+
+    return;
+}
+
+void americanFlagSort(int * a, int n) {
+    americanFlagSortLoop(a,n,24);
+
+    return;
+}
+
+#endif
@@ -0,0 +1,725 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "algo.h"
+#include "parallel.h"
+#include "generic.h"
+#include "records.h"
+#include "adaptive.h"
+#include "select.h"
+#include "multiway.h"
+#include "radix.h"
+#include "bytestrings.h"
+
+/*
+ * Benchmark of the sorting algorithms: every algorithm runs alone, on the
+ * same inputs, with the process pinned to one CPU (the pool of the parallel
+ * ones is created before, so its workers are not pinned):
+ * - inputs are generated from a fixed seed for each distribution and size,
+ *   so every run and every algorithm sorts the same arrays
+ * - every measure is the wall time from clock_gettime(CLOCK_MONOTONIC) of
+ *   sorting a fresh copy, after some warm up runs; short arrays are sorted
+ *   BENCH_BATCH elements at a time, in many copies, so that a measure is
+ *   not just the resolution of the clock
+ * - the output is one CSV line or JSON object for every algorithm, key
+ *   type, distribution and size, with the median and the minimum time and
+ *   the median nanoseconds per element, and whether the output was in order;
+ *   the merge sorts also report their passes over the memory and the bytes
+ *   read and written per element
+ * - the keys other than int32 are made from the same int inputs, so the
+ *   distributions keep their order: int64 timestamps, float and double
+ *   around 0, strings like "key:%010d", in the order of the ints, and pairs
+ *   of the int key and its index as payload, packed in an array of structs
+ *   or in separate payload and key arrays, sorted through the permutation
+ * - with -t k the selections of the k smallest run too, and are in order
+ *   when the first k are the k smallest, sorted but for intro-select
+ */
+
+#define BENCH_BATCH (1<<16) //elements sorted in a single measure at least
+#define BENCH_QUADRATIC_MAX (1<<14) //largest size for the O(n^2) cases
+#define BENCH_DOMAIN_MAX (1<<20) //largest domain for the counting sorts
+#define BENCH_SELECT_CHUNK 4096 //elements pushed at a time in the streaming top-k
+
+struct pool_t * pool;
+
+int benchDomain; //max+1 of the input, for the counting sorts
+int benchK; //of the selections, 0 to not run them
+int benchKth; //the k-th smallest of the input, for the selections
+
+struct multiwayStats_t benchMultiwayStats; //of the last Multiway Merge Sort
+
+void benchCounting(int * a, int n) { countingSort(a,n,benchDomain); }
+void benchCountingStable(int * a, int n) { countingStableSort(a,n,benchDomain); }
+void benchQsort(int * a, int n) { qsort(a,n,sizeof(int),cmpintasc); }
+void benchIntroGeneric(int * a, int n) { introSortInt32(a,n); }
+void benchAdaptive(int * a, int n) { sort(a,n); }
+void benchMultiway(int * a, int n) { multiwayMergeSortStats(a,n,&benchMultiwayStats); }
+void benchMergeParallel(int * a, int n) { parallelMergeSort(pool,a,n); }
+void benchSampleParallel(int * a, int n) { parallelSampleSort(pool,a,n); }
+void benchCountParallel(int * a, int n) { parallelCountingSort(pool,a,n); }
+void benchCountStableParallel(int * a, int n) { parallelCountingStableSort(pool,a,n); }
+void benchIntroSelect(int * a, int n) { introSelect(a,n,benchK-1); }
+void benchPartialSort(int * a, int n) { partialSort(a,n,benchK); }
+
+// the k smallest in a[0..k), with the SIMD filter of simdLevel
+void benchTopK(int * a, int n) {
+    struct topK_t t;
+    long i;
+
+    topKInit(&t,benchK);
+    for(i=0;i<n;i+=BENCH_SELECT_CHUNK) topKPush(&t,&a[i],n-i<BENCH_SELECT_CHUNK ? n-i : BENCH_SELECT_CHUNK);
+    topKResult(&t,a);
+    topKFree(&t);
+
+    return;
+}
+
+void benchTopKScalar(int * a, int n) {
+    int level = simdLevel;
+
+    simdLevel = SIMD_SCALAR;
+    benchTopK(a,n);
+    simdLevel = level;
+
+    return;
+}
+
+#define QUADRATIC_NEVER 0
+#define QUADRATIC_ALWAYS 1
+#define QUADRATIC_PRESORTED 2 //first element pivot, so not on benchPresorted
+
+#define SELECT_NEVER 0
+#define SELECT_PARTITION 1 //the k smallest first, the k-th in its place
+#define SELECT_SORTED 2 //the k smallest first, in order
+#define SELECT_TOP 3 //the k smallest first, in order, the rest undefined
+
+struct benchAlgo_t {
+    char * name;
+    void (* sort)(int *, int);
+    int quadratic;
+    int counting;
+    int select;
+};
+
+struct benchAlgo_t benchAlgos[] = {
+    {"bubble",bubbleSort,QUADRATIC_ALWAYS,0,SELECT_NEVER},
+    {"insert",insertionSort,QUADRATIC_ALWAYS,0,SELECT_NEVER},
+    {"merge",mergeSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"merge-natural",naturalMergeSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"merge-multiway",benchMultiway,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"block-merge",blockMergeSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"quick",quickSort,QUADRATIC_PRESORTED,0,SELECT_NEVER},
+    {"quick-glibc",benchQsort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"heap",heapSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"intro",introSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"intro-generic",benchIntroGeneric,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"pdq",pdqSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"simd",simdSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"adaptive",benchAdaptive,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"count",benchCounting,QUADRATIC_NEVER,1,SELECT_NEVER},
+    {"count-stable",benchCountingStable,QUADRATIC_NEVER,1,SELECT_NEVER},
+    {"radix",radixSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"american-flag",americanFlagSort,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"merge-parallel",benchMergeParallel,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"sample-parallel",benchSampleParallel,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"count-parallel",benchCountParallel,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"count-stable-parallel",benchCountStableParallel,QUADRATIC_NEVER,0,SELECT_NEVER},
+    {"intro-select",benchIntroSelect,QUADRATIC_NEVER,0,SELECT_PARTITION},
+    {"partial-sort",benchPartialSort,QUADRATIC_NEVER,0,SELECT_SORTED},
+    {"top-k",benchTopK,QUADRATIC_NEVER,0,SELECT_TOP},
+    {"top-k-scalar",benchTopKScalar,QUADRATIC_NEVER,0,SELECT_TOP},
+};
+
+#define BENCH_ALGOS ((int)(sizeof(benchAlgos)/sizeof(benchAlgos[0])))
+
+void benchRadixInt64(void * a, long n) { radixSort64(a,n); }
+void benchIntroInt64(void * a, long n) { introSortInt64(a,n); }
+void benchQsortInt64(void * a, long n) { qsort(a,n,sizeof(int64_t),compareInt64); }
+void benchRadixFloat(void * a, long n) { radixSortFloat(a,n); }
+void benchIntroFloat(void * a, long n) { introSortFloat(a,n); }
+void benchQsortFloat(void * a, long n) { qsort(a,n,sizeof(float),compareFloat); }
+void benchRadixDouble(void * a, long n) { radixSortDouble(a,n); }
+void benchIntroDouble(void * a, long n) { introSortDouble(a,n); }
+void benchQsortDouble(void * a, long n) { qsort(a,n,sizeof(double),compareDouble); }
+void benchMultikeyString(void * a, long n) { stringSort(a,n); }
+void benchQsortString(void * a, long n) { qsort(a,n,sizeof(struct byteString_t),stringCompare); }
+void benchIntroPair32(void * a, long n) { introSortPair32(a,n); }
+void benchMergePair32(void * a, long n) { mergeSortPair32(a,n); }
+void benchRadixPair32(void * a, long n) { radixSortPair32(a,n); }
+void benchCountingPair32(void * a, long n) { countingStableSortPair32(a,n,benchDomain); }
+void benchIntroPair64(void * a, long n) { introSortPair64(a,n); }
+void benchMergePair64(void * a, long n) { mergeSortPair64(a,n); }
+void benchRadixPair64(void * a, long n) { radixSortPair64(a,n); }
+void benchCountingPair64(void * a, long n) { countingStableSortPair64(a,n,benchDomain); }
+
+// sorts the payloads a[0..n) and the keys after them with the permutation
+// of the keys, applied to new arrays that are copied back
+void benchColumns(void * a, long n, size_t valueSize, int counting) {
+    int * keys = (int *)((char *)a+valueSize*n);
+    char * sorted = malloc((valueSize+sizeof(int))*n);
+    uint32_t * perm = malloc(sizeof(uint32_t)*n);
+    struct column_t columns[2] = {{keys,sorted+valueSize*n,sizeof(int)},{a,sorted,valueSize}};
+
+    if(counting) argCountingSort(keys,n,perm,benchDomain);
+    else argSort(keys,n,perm);
+    applyPermutation(perm,n,columns,2);
+    memcpy(a,sorted,(valueSize+sizeof(int))*n);
+
+    free(sorted);
+    free(perm);
+
+    return;
+}
+
+void benchArgsort32(void * a, long n) { benchColumns(a,n,sizeof(uint32_t),0); }
+void benchArgCounting32(void * a, long n) { benchColumns(a,n,sizeof(uint32_t),1); }
+void benchArgsort64(void * a, long n) { benchColumns(a,n,sizeof(uint64_t),0); }
+void benchArgCounting64(void * a, long n) { benchColumns(a,n,sizeof(uint64_t),1); }
+
+// the keys of type k made from the ints of input; strings are written in
+// text, 16 bytes for every key
+void benchMakeKeys(int k, int * input, long n, void * keys, char * text) {
+    long i;
+
+    for(i=0;i<n;i++) {
+        switch(k) {
+            case 1: ((int64_t *)keys)[i] = 1700000000000000000ll+input[i]*1000003ll; break;
+            case 2: ((float *)keys)[i] = (input[i]-INT_MAX/2)/1000.0f; break;
+            case 3: ((double *)keys)[i] = (input[i]-INT_MAX/2)/1000.0; break;
+            case 4:
+                ((struct byteString_t *)keys)[i].data = (unsigned char *)&text[16*i];
+                ((struct byteString_t *)keys)[i].len = snprintf(&text[16*i],16,"key:%010d",input[i]);
+                break;
+            case 5: ((struct pair32_t *)keys)[i] = (struct pair32_t){input[i],i}; break;
+            case 6: ((struct pair64_t *)keys)[i] = (struct pair64_t){input[i],i}; break;
+            case 7:
+                ((uint32_t *)keys)[i] = i;
+                ((int *)((uint32_t *)keys+n))[i] = input[i];
+                break;
+            case 8:
+                ((uint64_t *)keys)[i] = i;
+                ((int *)((uint64_t *)keys+n))[i] = input[i];
+                break;
+        }
+    }
+
+    return;
+}
+
+// the key and the payload of the i-th pair of a[0..n) of key type k
+long benchPairKey(int k, void * a, long n, long i) {
+    if(k==5) return ((struct pair32_t *)a)[i].key;
+    if(k==6) return ((struct pair64_t *)a)[i].key;
+    if(k==7) return ((int *)((uint32_t *)a+n))[i];
+    return ((int *)((uint64_t *)a+n))[i];
+}
+
+long benchPairValue(int k, void * a, long i) {
+    if(k==5) return ((struct pair32_t *)a)[i].value;
+    if(k==6) return ((struct pair64_t *)a)[i].value;
+    if(k==7) return ((uint32_t *)a)[i];
+    return ((uint64_t *)a)[i];
+}
+
+// 1 if a[0..n) of key type k is in order, and, for the pairs, every payload
+// is still the index of its key in input
+int benchKeysInOrder(int k, void * a, long n, int * input) {
+    long i;
+    int inOrder = 1;
+
+    for(i=1;i<n;i++) {
+        switch(k) {
+            case 1: inOrder &= ((int64_t *)a)[i-1]<=((int64_t *)a)[i]; break;
+            case 2: inOrder &= ((float *)a)[i-1]<=((float *)a)[i]; break;
+            case 3: inOrder &= ((double *)a)[i-1]<=((double *)a)[i]; break;
+            case 4: inOrder &= stringCompare(&((struct byteString_t *)a)[i-1],&((struct byteString_t *)a)[i])<=0; break;
+            default: inOrder &= benchPairKey(k,a,n,i-1)<=benchPairKey(k,a,n,i); break;
+        }
+    }
+    for(i=0;i<n && k>=5;i++) inOrder &= input[benchPairValue(k,a,i)]==benchPairKey(k,a,n,i);
+
+    return inOrder;
+}
+
+char * benchKeys[] = {"int32","int64","float","double","string",
+    "pair32","pair64","pair32-columns","pair64-columns"};
+
+// the columns of 64 bit payloads take 16 bytes a pair, not 12, so that
+// every copy in the work array starts aligned to 8
+size_t benchKeySize[] = {sizeof(int),sizeof(int64_t),sizeof(float),sizeof(double),sizeof(struct byteString_t),
+    sizeof(struct pair32_t),sizeof(struct pair64_t),sizeof(uint32_t)+sizeof(int),2*sizeof(uint64_t)};
+
+#define BENCH_KEYS ((int)(sizeof(benchKeys)/sizeof(benchKeys[0])))
+
+// the sorts of the keys other than int32, named as the int ones they match
+struct benchKeyAlgo_t {
+    char * name;
+    int keys;
+    void (* sort)(void *, long);
+    int counting;
+};
+
+struct benchKeyAlgo_t benchKeyAlgos[] = {
+    {"quick-glibc",1,benchQsortInt64,0},
+    {"intro-generic",1,benchIntroInt64,0},
+    {"radix",1,benchRadixInt64,0},
+    {"quick-glibc",2,benchQsortFloat,0},
+    {"intro-generic",2,benchIntroFloat,0},
+    {"radix",2,benchRadixFloat,0},
+    {"quick-glibc",3,benchQsortDouble,0},
+    {"intro-generic",3,benchIntroDouble,0},
+    {"radix",3,benchRadixDouble,0},
+    {"quick-glibc",4,benchQsortString,0},
+    {"multikey-quick",4,benchMultikeyString,0},
+    {"intro-generic",5,benchIntroPair32,0},
+    {"merge",5,benchMergePair32,0},
+    {"radix",5,benchRadixPair32,0},
+    {"count-stable",5,benchCountingPair32,1},
+    {"intro-generic",6,benchIntroPair64,0},
+    {"merge",6,benchMergePair64,0},
+    {"radix",6,benchRadixPair64,0},
+    {"count-stable",6,benchCountingPair64,1},
+    {"argsort",7,benchArgsort32,0},
+    {"argsort-counting",7,benchArgCounting32,1},
+    {"argsort",8,benchArgsort64,0},
+    {"argsort-counting",8,benchArgCounting64,1},
+};
+
+#define BENCH_KEY_ALGOS ((int)(sizeof(benchKeyAlgos)/sizeof(benchKeyAlgos[0])))
+
+char * benchDistributions[] = {
+    "random",
+    "sorted",
+    "reversed",
+    "few-unique",
+    "organ-pipe",
+    "sawtooth",
+    "nearly-sorted",
+    "zipf",
+};
+
+// the ones where the first element is a bad pivot
+int benchPresorted[] = {0,1,1,0,1,1,1,0};
+
+#define BENCH_DISTRIBUTIONS ((int)(sizeof(benchDistributions)/sizeof(benchDistributions[0])))
+
+// splitmix64, so that the inputs are the same on every machine
+uint64_t benchNext(uint64_t * state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+
+    z = (z^(z>>30))*0xBF58476D1CE4E5B9ull;
+    z = (z^(z>>27))*0x94D049BB133111EBull;
+
+    return z^(z>>31);
+}
+
+// uniform in [0,1)
+double benchUniform(uint64_t * state) {
+    return (benchNext(state)>>11)*0x1.0p-53;
+}
+
+// fills a with distribution d, all values in [0,INT_MAX]
+void benchGenerate(int * a, long n, int d, uint64_t seed) {
+    uint64_t state = seed^(0x51ED27ull*(d+1))^((uint64_t)n<<20);
+    long i, j, tmp, swaps;
+
+    for(i=0;i<n;i++) {
+        switch(d) {
+            case 0: a[i] = benchNext(&state)&INT_MAX; break;
+            case 1: a[i] = i; break;
+            case 2: a[i] = n-1-i; break;
+            case 3: a[i] = benchNext(&state)&15; break;
+            case 4: a[i] = i<n/2 ? i : n-1-i; break;
+            case 5: a[i] = i%(n/8+1); break;
+            case 6: a[i] = i; break;
+            // rank k has probability about 1/(k+1), for s=1 and n ranks
+            case 7: a[i] = (int)exp(benchUniform(&state)*log((double)n+1))-1; break;
+        }
+    }
+
+    // 1% of the elements swapped with random ones
+    if(d==6) {
+        for(swaps=0;swaps<n/100+1 && n>1;swaps++) {
+            i = benchNext(&state)%n;
+            tmp = benchNext(&state)%n;
+            j = a[i];
+            a[i] = a[tmp];
+            a[tmp] = j;
+        }
+    }
+
+    return;
+}
+
+double benchNow(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC,&t);
+
+    return t.tv_sec+t.tv_nsec*1e-9;
+}
+
+int benchCompareDouble(const void * x, const void * y) {
+    return (*(double *)x > *(double *)y) - (*(double *)x < *(double *)y);
+}
+
+// 1 if the k smallest of a[0..n) are first, as the output of the selection
+// of that kind
+int benchSelected(int * a, long n, int select) {
+    long i;
+    int inOrder = a[benchK-1]==benchKth;
+
+    for(i=0;i<benchK;i++) inOrder &= a[i]<=benchKth;
+    for(i=1;i<benchK && select!=SELECT_PARTITION;i++) inOrder &= a[i-1]<=a[i];
+    for(i=benchK;i<n && select!=SELECT_TOP;i++) inOrder &= a[i]>=benchKth;
+
+    return inOrder;
+}
+
+struct benchResult_t {
+    double median;
+    double min;
+    int inOrder;
+};
+
+// sorts copies of input with algo, warmup times and then repeat measures;
+// work holds BENCH_BATCH elements, or n if it is bigger
+void benchRun(struct benchAlgo_t * algo, int * input, int * work, long n,
+        int warmup, int repeat, struct benchResult_t * result) {
+    long copies = n<BENCH_BATCH ? BENCH_BATCH/n : 1;
+    long c;
+    int r;
+    double start, * times = malloc(sizeof(double)*repeat);
+
+    result->inOrder = 1;
+    for(r=-warmup;r<repeat;r++) {
+        for(c=0;c<copies;c++) memcpy(&work[c*n],input,sizeof(int)*n);
+
+        start = benchNow();
+        for(c=0;c<copies;c++) algo->sort(&work[c*n],n);
+        if(r>=0) times[r] = (benchNow()-start)/copies;
+
+        for(c=0;c<copies;c++)
+            result->inOrder &= algo->select ? benchSelected(&work[c*n],n,algo->select) : checkOrder(&work[c*n],n);
+    }
+
+    qsort(times,repeat,sizeof(double),benchCompareDouble);
+    result->median = repeat%2 ? times[repeat/2] : (times[repeat/2-1]+times[repeat/2])/2;
+    result->min = times[0];
+
+    free(times);
+
+    return;
+}
+
+// passes over the memory of the bottom-up merges of runs of len elements
+int benchMergePasses(long n, long len) {
+    int passes = 0;
+
+    for(;len<n;len*=2) passes++;
+
+    return passes;
+}
+
+// passes over the memory of the last run of a merge sort, and the bytes
+// read and written per element, 0 for the other sorts: Merge Sort copies
+// both halves out and merges them back at every level; Natural Merge Sort
+// sorts runs of minRunLength in place, then merges between the array and
+// the buffer, with a copy back if the merges are odd
+int benchPasses(struct benchAlgo_t * algo, long n, double * bytes) {
+    int passes = 0;
+
+    if(algo->sort==mergeSort) {
+        passes = benchMergePasses(n,1);
+        *bytes = 4*sizeof(int)*passes;
+    }
+    else if(algo->sort==naturalMergeSort) {
+        passes = benchMergePasses(n,minRunLength(n));
+        passes = 1+passes+passes%2;
+        *bytes = 2*sizeof(int)*passes;
+    }
+    else if(algo->sort==benchMultiway) {
+        passes = benchMultiwayStats.passes;
+        *bytes = benchMultiwayStats.bytesPerElement;
+    }
+
+    return passes;
+}
+
+// benchRun for the keys other than int32, on keys made from the input
+void benchRunKeys(struct benchKeyAlgo_t * algo, void * keys, int * input, char * work, long n,
+        int warmup, int repeat, struct benchResult_t * result) {
+    size_t size = benchKeySize[algo->keys];
+    long copies = n<BENCH_BATCH ? BENCH_BATCH/n : 1;
+    long c;
+    int r;
+    double start, * times = malloc(sizeof(double)*repeat);
+
+    result->inOrder = 1;
+    for(r=-warmup;r<repeat;r++) {
+        for(c=0;c<copies;c++) memcpy(&work[c*n*size],keys,size*n);
+
+        start = benchNow();
+        for(c=0;c<copies;c++) algo->sort(&work[c*n*size],n);
+        if(r>=0) times[r] = (benchNow()-start)/copies;
+
+        for(c=0;c<copies;c++) result->inOrder &= benchKeysInOrder(algo->keys,&work[c*n*size],n,input);
+    }
+
+    qsort(times,repeat,sizeof(double),benchCompareDouble);
+    result->median = repeat%2 ? times[repeat/2] : (times[repeat/2-1]+times[repeat/2])/2;
+    result->min = times[0];
+
+    free(times);
+
+    return;
+}
+
+void benchPrint(FILE * out, int json, int first, char * algo, int k, int d, long n,
+        struct benchResult_t * result, int passes, double bytes) {
+    char memory[64] = "";
+
+    if(json) {
+        if(passes) snprintf(memory,64,", \"passes\": %d, \"bytes_per_element\": %.0f",passes,bytes);
+        fprintf(out,"%s  {\"algorithm\": \"%s\", \"keys\": \"%s\", \"distribution\": \"%s\", \"size\": %ld, "
+                "\"median_s\": %.9f, \"min_s\": %.9f, \"median_ns_per_element\": %.3f, \"in_order\": %s%s}",
+                first ? "" : ",\n",algo,benchKeys[k],benchDistributions[d],n,
+                result->median,result->min,result->median*1e9/n,result->inOrder ? "true" : "false",memory);
+    }
+    else {
+        if(passes) snprintf(memory,64,"%d,%.0f",passes,bytes);
+        else strcpy(memory,",");
+        fprintf(out,"%s,%s,%s,%ld,%.9f,%.9f,%.3f,%d,%s\n",
+                algo,benchKeys[k],benchDistributions[d],n,
+                result->median,result->min,result->median*1e9/n,result->inOrder,memory);
+    }
+    fflush(out);
+
+    return;
+}
+
+void benchUsage(char * name) {
+    int i;
+
+    fprintf(stderr,
+            "Usage: %s [options] [algorithm ...]\n"
+            "  -n sizes         comma separated sizes, or min:max for the powers of 10\n"
+            "                   between them (default 10:10000000)\n"
+            "  -d distributions comma separated (default all)\n"
+            "  -k keys          comma separated key types (default int32)\n"
+            "  -t k             also select the k smallest (default 0, not run)\n"
+            "  -r repeat        measures for every case (default 7)\n"
+            "  -w warmup        runs before measuring (default 1)\n"
+            "  -s seed          seed of the inputs (default 1)\n"
+            "  -c cpu           CPU to pin to, -1 to not pin (default 0)\n"
+            "  -p threads       threads of the parallel algorithms (default all)\n"
+            "  -f csv|json      output format (default csv)\n"
+            "  -o file          output file (default stdout)\n"
+            "Algorithms (default all):",name);
+    for(i=0;i<BENCH_ALGOS;i++) fprintf(stderr," %s",benchAlgos[i].name);
+    fprintf(stderr," multikey-quick argsort argsort-counting\nKeys:");
+    for(i=0;i<BENCH_KEYS;i++) fprintf(stderr," %s",benchKeys[i]);
+    fprintf(stderr,"\nDistributions:");
+    for(i=0;i<BENCH_DISTRIBUTIONS;i++) fprintf(stderr," %s",benchDistributions[i]);
+    fprintf(stderr,"\n");
+
+    return;
+}
+
+// parses "10,1000" or "10:1e9" in sizes, returns how many
+int benchParseSizes(char * arg, long * sizes, int max) {
+    char * colon = strchr(arg,':'), * token;
+    long size, last;
+    int count = 0;
+
+    if(colon!=NULL) {
+        last = strtod(colon+1,NULL);
+        for(size=strtod(arg,NULL);size>0 && size<=last && count<max;size*=10)
+            sizes[count++] = size;
+        return count;
+    }
+
+    for(token=strtok(arg,",");token!=NULL && count<max;token=strtok(NULL,",")) {
+        size = strtod(token,NULL);
+        if(size>0) sizes[count++] = size;
+    }
+
+    return count;
+}
+
+int main(int argc, char * argv[]) {
+    long sizes[64], n, i, workDim;
+    size_t keyBytes;
+    int sizeCount, opt, d, s, k, t, first = 1, domain;
+    int warmup = 1, repeat = 7, cpu = 0, json = 0, threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int selected[BENCH_ALGOS], selectedKeys[BENCH_KEY_ALGOS], distributions[BENCH_DISTRIBUTIONS], passes;
+    int keyTypes[BENCH_KEYS] = {1};
+    uint64_t seed = 1;
+    char defaultSizes[] = "10:10000000", * token;
+    int * input;
+    char * work, * keys, * text;
+    double bytes;
+    FILE * out = stdout;
+    cpu_set_t set;
+    struct benchResult_t result;
+
+    sizeCount = benchParseSizes(defaultSizes,sizes,64);
+    for(d=0;d<BENCH_DISTRIBUTIONS;d++) distributions[d] = 1;
+
+    while((opt = getopt(argc,argv,"n:d:k:t:r:w:s:c:p:f:o:h"))!=-1) {
+        switch(opt) {
+            case 'n': sizeCount = benchParseSizes(optarg,sizes,64); break;
+            case 'd':
+                for(d=0;d<BENCH_DISTRIBUTIONS;d++) distributions[d] = 0;
+                for(token=strtok(optarg,",");token!=NULL;token=strtok(NULL,",")) {
+                    for(d=0;d<BENCH_DISTRIBUTIONS && strcmp(token,benchDistributions[d]);d++);
+                    if(d==BENCH_DISTRIBUTIONS) {
+                        fprintf(stderr,"Error: there is no distribution %s\n",token);
+                        return 1;
+                    }
+                    distributions[d] = 1;
+                }
+                break;
+            case 'k':
+                for(t=0;t<BENCH_KEYS;t++) keyTypes[t] = 0;
+                for(token=strtok(optarg,",");token!=NULL;token=strtok(NULL,",")) {
+                    for(t=0;t<BENCH_KEYS && strcmp(token,benchKeys[t]);t++);
+                    if(t==BENCH_KEYS) {
+                        fprintf(stderr,"Error: there are no keys %s\n",token);
+                        return 1;
+                    }
+                    keyTypes[t] = 1;
+                }
+                break;
+            case 't': benchK = atoi(optarg)>0 ? atoi(optarg) : 0; break;
+            case 'r': repeat = atoi(optarg)>0 ? atoi(optarg) : 1; break;
+            case 'w': warmup = atoi(optarg)>0 ? atoi(optarg) : 0; break;
+            case 's': seed = strtoull(optarg,NULL,0); break;
+            case 'c': cpu = atoi(optarg); break;
+            case 'p': threads = atoi(optarg); break;
+            case 'f': json = strcmp(optarg,"json")==0; break;
+            case 'o':
+                if((out = fopen(optarg,"w"))==NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                benchUsage(argv[0]);
+                return opt=='h' ? 0 : 1;
+        }
+    }
+
+    for(k=0;k<BENCH_ALGOS;k++) selected[k] = optind==argc;
+    for(k=0;k<BENCH_KEY_ALGOS;k++) selectedKeys[k] = optind==argc;
+    for(i=optind;i<argc;i++) {
+        for(k=0,t=0;k<BENCH_ALGOS;k++)
+            if(strcmp(argv[i],benchAlgos[k].name) == 0) t = selected[k] = 1;
+        for(k=0;k<BENCH_KEY_ALGOS;k++)
+            if(strcmp(argv[i],benchKeyAlgos[k].name) == 0) t = selectedKeys[k] = 1;
+        if(!t) {
+            fprintf(stderr,"Error: there is no algorithm with such name: %s\n",argv[i]);
+            return 1;
+        }
+    }
+
+    // the work array holds the largest of the keys
+    for(t=0,keyBytes=sizeof(int);t<BENCH_KEYS;t++)
+        if(keyTypes[t] && benchKeySize[t]>keyBytes) keyBytes = benchKeySize[t];
+
+    pool = poolCreate(threads);
+
+    if(cpu>=0) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu,&set);
+        if(sched_setaffinity(0,sizeof(set),&set)) perror("sched_setaffinity");
+    }
+
+    if(json) fprintf(out,"{\"seed\": %llu, \"cpu\": %d, \"threads\": %d, \"warmup\": %d, \"repeat\": %d, \"results\": [\n",
+            (unsigned long long)seed,cpu,threads,warmup,repeat);
+    else fprintf(out,"algorithm,keys,distribution,size,median_s,min_s,median_ns_per_element,in_order,"
+            "passes,bytes_per_element\n");
+
+    for(s=0;s<sizeCount;s++) {
+        n = sizes[s];
+        workDim = n<BENCH_BATCH ? BENCH_BATCH/n*n : n;
+        input = n<=INT_MAX ? malloc(sizeof(int)*n) : NULL;
+        work = n<=INT_MAX ? malloc(keyBytes*workDim) : NULL;
+        keys = n<=INT_MAX ? malloc(keyBytes*n) : NULL;
+        text = n<=INT_MAX && keyTypes[4] ? malloc(16*n) : NULL;
+        if(input==NULL || work==NULL || keys==NULL || (keyTypes[4] && text==NULL)) {
+            fprintf(stderr,"Skipping size %ld: not enough memory\n",n);
+            free(input);
+            free(work);
+            free(keys);
+            free(text);
+            continue;
+        }
+
+        for(d=0;d<BENCH_DISTRIBUTIONS;d++) {
+            if(!distributions[d]) continue;
+
+            benchGenerate(input,n,d,seed);
+            for(i=0,domain=0;i<n;i++) domain = input[i]>domain ? input[i] : domain;
+            benchDomain = domain+1;
+            if(benchK>0 && benchK<=n) {
+                memcpy(work,input,sizeof(int)*n);
+                introSelect((int *)work,n,benchK-1);
+                benchKth = ((int *)work)[benchK-1];
+            }
+
+            for(k=0;k<BENCH_ALGOS && keyTypes[0];k++) {
+                if(!selected[k]) continue;
+                if(benchAlgos[k].counting && domain>=BENCH_DOMAIN_MAX) continue;
+                if(benchAlgos[k].select && (benchK==0 || benchK>n)) continue;
+                if(n>BENCH_QUADRATIC_MAX && (benchAlgos[k].quadratic==QUADRATIC_ALWAYS ||
+                            (benchAlgos[k].quadratic==QUADRATIC_PRESORTED && benchPresorted[d])))
+                    continue;
+
+                fprintf(stderr,"%s %s %ld\n",benchAlgos[k].name,benchDistributions[d],n);
+                benchRun(&benchAlgos[k],input,(int *)work,n,warmup,repeat,&result);
+                passes = benchPasses(&benchAlgos[k],n,&bytes);
+                benchPrint(out,json,first,benchAlgos[k].name,0,d,n,&result,passes,bytes);
+                first = 0;
+            }
+
+            for(t=1;t<BENCH_KEYS;t++) {
+                if(!keyTypes[t]) continue;
+
+                benchMakeKeys(t,input,n,keys,text);
+                for(k=0;k<BENCH_KEY_ALGOS;k++) {
+                    if(!selectedKeys[k] || benchKeyAlgos[k].keys!=t) continue;
+                    if(benchKeyAlgos[k].counting && domain>=BENCH_DOMAIN_MAX) continue;
+
+                    fprintf(stderr,"%s %s %s %ld\n",benchKeyAlgos[k].name,benchKeys[t],benchDistributions[d],n);
+                    benchRunKeys(&benchKeyAlgos[k],keys,input,work,n,warmup,repeat,&result);
+                    benchPrint(out,json,first,benchKeyAlgos[k].name,t,d,n,&result,0,0);
+                    first = 0;
+                }
+            }
+        }
+
+        free(input);
+        free(work);
+        free(keys);
+        free(text);
+    }
+
+    if(json) fprintf(out,"\n]}\n");
+    if(out!=stdout) fclose(out);
+
+    poolDestroy(pool);
+
+    return 0;
+}
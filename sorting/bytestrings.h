@@ -0,0 +1,167 @@
+#ifndef H_SORTING_BYTESTRINGS
+#define H_SORTING_BYTESTRINGS
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * String Sort sorts byte strings, which may hold any byte also 0, in the
+ * order of memcmp, a string before the longer ones it is a prefix of. It
+ * is Multikey Quick Sort (by Bentley and Sedgewick) on 8 bytes at a time:
+ * - Time complexity: $O(n\log(n)+D/8)$ word comparisons on average, with D
+ *   the bytes that have to be read to tell the strings apart
+ * - Space complexity: $O(n)$, 8 bytes of cache per string
+ * - Stability: No
+ * - Optimizations: the next 8 bytes of every string, from the depth of its
+ *   partition, are kept in a cache next to the array, as a big endian word
+ *   with zeros after the end, so a comparison is one of 64 bit ints, with
+ *   no pointer to follow; the partition is in three, and only the strings
+ *   equal to the pivot in those 8 bytes go 8 bytes deeper and load their
+ *   cache again, the others keep it; the equal strings that end in the word
+ *   are already in place after sorting them by length; the pivot is the
+ *   median of 9 words on large partitions, since the partition in three
+ *   leaves sorted inputs in an order that fools the median of 3; short
+ *   partitions are sorted by Insertion Sort on the cache
+ */
+
+#define STRING_SMALL 16
+#define STRING_NINTHER 64
+
+struct byteString_t {
+    const unsigned char * data;
+    size_t len;
+};
+
+// 8 bytes of s from depth, big endian, with zeros after the end
+static inline uint64_t stringWord(const struct byteString_t * s, size_t depth) {
+    uint64_t w = 0;
+    size_t i;
+
+    if(depth+8<=s->len) {
+        memcpy(&w,&s->data[depth],8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        w = __builtin_bswap64(w);
+#endif
+        return w;
+    }
+
+    for(i=depth;i<s->len;i++) w |= (uint64_t)s->data[i]<<(56-8*(i-depth));
+
+    return w;
+}
+
+static inline uint64_t stringMedian(uint64_t x, uint64_t y, uint64_t z) {
+    return x<y ? (y<z ? y : (x<z ? z : x)) : (x<z ? x : (y<z ? z : y));
+}
+
+// compares x and y from the byte from on, knowing the bytes before equal
+int stringCompareFrom(const struct byteString_t * x, const struct byteString_t * y, size_t from) {
+    size_t m = x->len<y->len ? x->len : y->len;
+    int c;
+
+    if(m>from && (c = memcmp(&x->data[from],&y->data[from],m-from))!=0) return c;
+
+    return (x->len>y->len)-(x->len<y->len);
+}
+
+// for qsort
+int stringCompare(const void * x, const void * y) {
+    return stringCompareFrom(x,y,0);
+}
+
+void stringSwap(struct byteString_t * a, uint64_t * w, long i, long j) {
+    struct byteString_t tmp = a[i];
+    uint64_t t = w[i];
+
+    a[i] = a[j];
+    a[j] = tmp;
+    w[i] = w[j];
+    w[j] = t;
+
+    return;
+}
+
+// strings with the first depth bytes equal, and w their words from depth
+// if cached
+void stringSortLoop(struct byteString_t * a, uint64_t * w, long n, size_t depth, int cached) {
+    long i, j, lt, gt, done;
+    uint64_t pivot, x, y, z;
+    struct byteString_t tmp;
+    size_t len;
+
+    while(n>STRING_SMALL) {
+        if(!cached) for(i=0;i<n;i++) w[i] = stringWord(&a[i],depth);
+
+        // median of 3, or of the medians of 3 triples on larger ones
+        if(n>STRING_NINTHER) {
+            i = n/8;
+            x = stringMedian(w[0],w[i],w[2*i]);
+            y = stringMedian(w[n/2-i],w[n/2],w[n/2+i]);
+            z = stringMedian(w[n-1-2*i],w[n-1-i],w[n-1]);
+        }
+        else {
+            x = w[0];
+            y = w[n/2];
+            z = w[n-1];
+        }
+        pivot = stringMedian(x,y,z);
+
+        // [0,lt) smaller, [lt,i) equal, (gt,n) bigger
+        lt = 0;
+        gt = n-1;
+        for(i=0;i<=gt;) {
+            if(w[i]<pivot) stringSwap(a,w,lt++,i++);
+            else if(w[i]>pivot) stringSwap(a,w,i,gt--);
+            else i++;
+        }
+
+        stringSortLoop(a,w,lt,depth,1);
+        stringSortLoop(&a[gt+1],&w[gt+1],n-gt-1,depth,1);
+
+        // the equal ones that end in this word only differ by length
+        a += lt;
+        w += lt;
+        n = gt+1-lt;
+        for(i=0,done=0;i<n;i++)
+            if(a[i].len<=depth+8) stringSwap(a,w,done++,i);
+        for(len=depth,j=0;len<depth+8 && j<done;len++)
+            for(i=j;i<done;i++)
+                if(a[i].len==len) stringSwap(a,w,j++,i);
+
+        a += done;
+        w += done;
+        n -= done;
+        depth += 8;
+        cached = 0;
+    }
+
+    if(!cached) for(i=0;i<n;i++) w[i] = stringWord(&a[i],depth);
+
+    for(i=1;i<n;i++) {
+        tmp = a[i];
+        x = w[i];
+        for(j=i-1;j>=0 && (w[j]>x || (w[j]==x && stringCompareFrom(&a[j],&tmp,depth+8)>0));j--) {
+            a[j+1] = a[j];
+            w[j+1] = w[j];
+        }
+        a[j+1] = tmp;
+        w[j+1] = x;
+    }
+
+    return;
+}
+
+void stringSort(struct byteString_t * a, long n) {
+    uint64_t * w;
+
+    if(n<2) return;
+
+    w = malloc(sizeof(uint64_t)*n);
+    stringSortLoop(a,w,n,0,0);
+    free(w);
+
+    return;
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define MAX_RAND 8192 //Limit numbers from 0 to MAX_RAND -  - 11
 
@@ -30,9 +31,7 @@ void printArray(int * a, int n) {
 
 void copyArray(int * src, int * dst, int n) {
     
-    for(int i=0;i<n;i++) {
-        dst[i] = src[i];
-    }
+    memcpy(dst,src,sizeof(int)*n);
 
     return;
 }
@@ -71,10 +70,11 @@ void printResources(struct rusage * res) {
     return;
 }
 
-//comparison function to make qsort work with integers
+//comparison function to make qsort work with integers,
+//without subtracting them, which can overflow
 int cmpintasc(const void *n1, const void *n2) {
 
-    return (*(int *)n1 - *(int *)n2);
+    return (*(int *)n1 > *(int *)n2) - (*(int *)n1 < *(int *)n2);
 }
 
 #endif
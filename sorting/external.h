@@ -0,0 +1,567 @@
+#ifndef H_SORTING_EXTERNAL
+#define H_SORTING_EXTERNAL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "algo.h"
+
+/*
+ * External Merge Sort sorts binary files of 32 or 64 bit signed keys bigger
+ * than the memory: it cuts the input in runs that fit the memory budget,
+ * sorts them with Radix Sort and writes them to a temporary file, then merges
+ * them k at a time with a loser tree, in more passes if they do not fit:
+ * - Time complexity: $O(n\log(n))$, with $\lceil\log_k(r)\rceil$ merge passes
+ *   over the data for r runs
+ * - Space complexity: the memory budget, and a temporary file as big as the
+ *   input next to the output
+ * - Stability: No
+ * - Optimizations: a separate I/O thread does all the reads and writes, on
+ *   two aligned buffers per file, so it reads the next buffer of every run
+ *   and writes the previous buffer of the output while we merge; in the
+ *   merge the buffers share the budget, so they are as big as possible for
+ *   the number of runs; the loser tree needs a single comparison per level
+ *   to replace the winner
+ */
+
+#define EXTERNAL_ALIGN 4096
+#define EXTERNAL_IO_MAX (1<<22) //biggest I/O buffer
+#define EXTERNAL_IO_MIN (1<<16) //smallest I/O buffer in a merge
+
+struct ioRequest_t {
+    int fd;
+    int write;
+    char * buffer;
+    size_t size;
+    off_t offset;
+    ssize_t result; //bytes moved, or -1
+    int done;
+    struct ioRequest_t * next;
+};
+
+struct ioThread_t {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;
+    pthread_cond_t completed;
+    struct ioRequest_t * head;
+    struct ioRequest_t * tail;
+    int stop;
+};
+
+void * ioThreadLoop(void * arg) {
+    struct ioThread_t * io = arg;
+    struct ioRequest_t * req;
+    ssize_t moved, total;
+
+    while(1) {
+        pthread_mutex_lock(&io->lock);
+        while(io->head==NULL && !io->stop) pthread_cond_wait(&io->submitted,&io->lock);
+        if(io->head==NULL) {
+            pthread_mutex_unlock(&io->lock);
+            break;
+        }
+        req = io->head;
+        io->head = req->next;
+        if(io->head==NULL) io->tail = NULL;
+        pthread_mutex_unlock(&io->lock);
+
+        // a read stops early only at the end of the file
+        total = 0;
+        moved = 0;
+        while(total<(ssize_t)req->size) {
+            if(req->write) moved = pwrite(req->fd,req->buffer+total,req->size-total,req->offset+total);
+            else moved = pread(req->fd,req->buffer+total,req->size-total,req->offset+total);
+            if(moved<=0) break;
+            total += moved;
+        }
+        if(moved<0) total = -1;
+
+        pthread_mutex_lock(&io->lock);
+        req->result = total;
+        req->done = 1;
+        pthread_cond_broadcast(&io->completed);
+        pthread_mutex_unlock(&io->lock);
+    }
+
+    return NULL;
+}
+
+void ioStart(struct ioThread_t * io) {
+    pthread_mutex_init(&io->lock,NULL);
+    pthread_cond_init(&io->submitted,NULL);
+    pthread_cond_init(&io->completed,NULL);
+    io->head = io->tail = NULL;
+    io->stop = 0;
+    pthread_create(&io->thread,NULL,&ioThreadLoop,io);
+
+    return;
+}
+
+void ioStop(struct ioThread_t * io) {
+    pthread_mutex_lock(&io->lock);
+    io->stop = 1;
+    pthread_cond_signal(&io->submitted);
+    pthread_mutex_unlock(&io->lock);
+
+    pthread_join(io->thread,NULL);
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->submitted);
+    pthread_cond_destroy(&io->completed);
+
+    return;
+}
+
+// an empty request is done at once
+void ioSubmit(struct ioThread_t * io, struct ioRequest_t * req) {
+    req->next = NULL;
+    req->done = 0;
+    req->result = 0;
+
+    if(req->size==0) {
+        req->done = 1;
+        return;
+    }
+
+    pthread_mutex_lock(&io->lock);
+    if(io->tail==NULL) io->head = req;
+    else io->tail->next = req;
+    io->tail = req;
+    pthread_cond_signal(&io->submitted);
+    pthread_mutex_unlock(&io->lock);
+
+    return;
+}
+
+ssize_t ioWait(struct ioThread_t * io, struct ioRequest_t * req) {
+    pthread_mutex_lock(&io->lock);
+    while(!req->done) pthread_cond_wait(&io->completed,&io->lock);
+    pthread_mutex_unlock(&io->lock);
+
+    return req->result;
+}
+
+// reads [begin,end) of a file, one buffer ahead of the consumer
+struct runReader_t {
+    struct ioThread_t * io;
+    int fd;
+    off_t next; //where the next request starts
+    off_t end;
+    size_t dim;
+    char * buffer[2];
+    struct ioRequest_t request[2];
+    int current;
+    char * pos;
+    char * limit;
+    int keySize;
+    int error;
+};
+
+void readerRequest(struct runReader_t * r, int i) {
+    r->request[i].fd = r->fd;
+    r->request[i].write = 0;
+    r->request[i].buffer = r->buffer[i];
+    r->request[i].offset = r->next;
+    r->request[i].size = r->end-r->next<(off_t)r->dim ? r->end-r->next : r->dim;
+    r->next += r->request[i].size;
+    ioSubmit(r->io,&r->request[i]);
+
+    return;
+}
+
+void readerOpen(struct runReader_t * r, struct ioThread_t * io, int fd,
+        off_t begin, off_t end, size_t dim, int keySize) {
+    r->io = io;
+    r->fd = fd;
+    r->next = begin;
+    r->end = end;
+    r->dim = dim;
+    r->buffer[0] = aligned_alloc(EXTERNAL_ALIGN,dim);
+    r->buffer[1] = aligned_alloc(EXTERNAL_ALIGN,dim);
+    r->current = 0;
+    r->pos = r->limit = NULL;
+    r->keySize = keySize;
+    r->error = 0;
+
+    readerRequest(r,0);
+    readerRequest(r,1);
+
+    return;
+}
+
+// gives back the buffer just consumed for the read after the next one, and
+// waits for the next one; returns 0 at the end of the run
+int readerAdvance(struct runReader_t * r) {
+    ssize_t got;
+
+    if(r->pos!=NULL) {
+        readerRequest(r,r->current);
+        r->current ^= 1;
+    }
+
+    got = ioWait(r->io,&r->request[r->current]);
+    if(got!=(ssize_t)r->request[r->current].size) {
+        r->error = 1;
+        got = 0;
+    }
+    r->pos = r->buffer[r->current];
+    r->limit = r->pos+got;
+
+    return got>0;
+}
+
+int readerNext(struct runReader_t * r, int64_t * key) {
+    if(r->pos==r->limit && !readerAdvance(r)) return 0;
+
+    if(r->keySize==4) *key = *(int32_t *)r->pos;
+    else *key = *(int64_t *)r->pos;
+    r->pos += r->keySize;
+
+    return 1;
+}
+
+// copies up to size bytes, returns how many
+size_t readerRead(struct runReader_t * r, char * dst, size_t size) {
+    size_t done = 0, chunk;
+
+    while(done<size) {
+        if(r->pos==r->limit && !readerAdvance(r)) break;
+        chunk = r->limit-r->pos<(ssize_t)(size-done) ? (size_t)(r->limit-r->pos) : size-done;
+        memcpy(dst+done,r->pos,chunk);
+        r->pos += chunk;
+        done += chunk;
+    }
+
+    return done;
+}
+
+// waits for the reads still running before freeing the buffers
+int readerClose(struct runReader_t * r) {
+    ioWait(r->io,&r->request[0]);
+    ioWait(r->io,&r->request[1]);
+    free(r->buffer[0]);
+    free(r->buffer[1]);
+
+    return r->error ? -1 : 0;
+}
+
+// appends to a file from offset, writing a buffer while the other fills
+struct runWriter_t {
+    struct ioThread_t * io;
+    int fd;
+    off_t offset;
+    size_t dim;
+    char * buffer[2];
+    struct ioRequest_t request[2];
+    int pending[2];
+    int current;
+    size_t fill;
+    int keySize;
+    int error;
+};
+
+void writerOpen(struct runWriter_t * w, struct ioThread_t * io, int fd,
+        off_t offset, size_t dim, int keySize) {
+    w->io = io;
+    w->fd = fd;
+    w->offset = offset;
+    w->dim = dim;
+    w->buffer[0] = aligned_alloc(EXTERNAL_ALIGN,dim);
+    w->buffer[1] = aligned_alloc(EXTERNAL_ALIGN,dim);
+    w->pending[0] = w->pending[1] = 0;
+    w->current = 0;
+    w->fill = 0;
+    w->keySize = keySize;
+    w->error = 0;
+
+    return;
+}
+
+void writerFlush(struct runWriter_t * w) {
+    struct ioRequest_t * req = &w->request[w->current];
+
+    if(w->fill==0) return;
+
+    req->fd = w->fd;
+    req->write = 1;
+    req->buffer = w->buffer[w->current];
+    req->size = w->fill;
+    req->offset = w->offset;
+    ioSubmit(w->io,req);
+    w->pending[w->current] = 1;
+    w->offset += w->fill;
+    w->fill = 0;
+
+    // the other buffer can be filled once its write is over
+    w->current ^= 1;
+    req = &w->request[w->current];
+    if(w->pending[w->current] && ioWait(w->io,req)!=(ssize_t)req->size) w->error = 1;
+    w->pending[w->current] = 0;
+
+    return;
+}
+
+void writerPut(struct runWriter_t * w, int64_t key) {
+    if(w->keySize==4) *(int32_t *)(w->buffer[w->current]+w->fill) = key;
+    else *(int64_t *)(w->buffer[w->current]+w->fill) = key;
+    w->fill += w->keySize;
+
+    if(w->fill==w->dim) writerFlush(w);
+
+    return;
+}
+
+void writerWrite(struct runWriter_t * w, char * src, size_t size) {
+    size_t chunk;
+
+    while(size>0) {
+        chunk = w->dim-w->fill<size ? w->dim-w->fill : size;
+        memcpy(w->buffer[w->current]+w->fill,src,chunk);
+        w->fill += chunk;
+        src += chunk;
+        size -= chunk;
+        if(w->fill==w->dim) writerFlush(w);
+    }
+
+    return;
+}
+
+int writerClose(struct runWriter_t * w) {
+    int i;
+
+    writerFlush(w);
+    for(i=0;i<2;i++)
+        if(w->pending[i] && ioWait(w->io,&w->request[i])!=(ssize_t)w->request[i].size)
+            w->error = 1;
+    free(w->buffer[0]);
+    free(w->buffer[1]);
+
+    return w->error ? -1 : 0;
+}
+
+// loser tree on the heads of k runs: loser[node] is the run that lost the
+// match at an internal node 1..k-1, the leaf of run i is node k+i, and an
+// exhausted run loses against everything
+struct loserTree_t {
+    int k;
+    int winner;
+    int * loser;
+    int64_t * key;
+    int * done;
+};
+
+// whether the head of run i comes before the head of run j
+int loserLess(struct loserTree_t * t, int i, int j) {
+    if(t->done[i] || t->done[j]) return t->done[j] && (!t->done[i] || i<j);
+
+    return t->key[i]<t->key[j] || (t->key[i]==t->key[j] && i<j);
+}
+
+int loserBuild(struct loserTree_t * t, int node) {
+    int left, right;
+
+    if(node>=t->k) return node-t->k;
+
+    left = loserBuild(t,2*node);
+    right = loserBuild(t,2*node+1);
+    if(loserLess(t,left,right)) {
+        t->loser[node] = right;
+        return left;
+    }
+    t->loser[node] = left;
+
+    return right;
+}
+
+// the winner has a new head: it plays again on its path to the root
+void loserReplay(struct loserTree_t * t) {
+    int node, w = t->winner, tmp;
+
+    for(node=(w+t->k)/2;node>0;node/=2) {
+        if(loserLess(t,t->loser[node],w)) {
+            tmp = t->loser[node];
+            t->loser[node] = w;
+            w = tmp;
+        }
+    }
+    t->winner = w;
+
+    return;
+}
+
+// merges the runs [bounds[i],bounds[i+1]) of in, for i in [0,k), at the
+// offset of out
+int externalMerge(struct ioThread_t * io, int in, off_t * bounds, int k,
+        int out, off_t offset, size_t dim, int keySize) {
+    struct runReader_t * readers = malloc(sizeof(struct runReader_t)*k);
+    struct runWriter_t writer;
+    struct loserTree_t t;
+    int i, error = 0;
+
+    t.k = k;
+    t.loser = malloc(sizeof(int)*k);
+    t.key = malloc(sizeof(int64_t)*k);
+    t.done = malloc(sizeof(int)*k);
+
+    for(i=0;i<k;i++) {
+        readerOpen(&readers[i],io,in,bounds[i],bounds[i+1],dim,keySize);
+        t.done[i] = !readerNext(&readers[i],&t.key[i]);
+    }
+    writerOpen(&writer,io,out,offset,dim,keySize);
+
+    t.winner = loserBuild(&t,1);
+    while(!t.done[t.winner]) {
+        writerPut(&writer,t.key[t.winner]);
+        t.done[t.winner] = !readerNext(&readers[t.winner],&t.key[t.winner]);
+        loserReplay(&t);
+    }
+
+    for(i=0;i<k;i++) if(readerClose(&readers[i])) error = 1;
+    if(writerClose(&writer)) error = 1;
+
+    free(readers);
+    free(t.loser);
+    free(t.key);
+    free(t.done);
+
+    return error ? -1 : 0;
+}
+
+// a temporary file next to path, already unlinked
+int externalTemp(const char * path) {
+    char * name = malloc(strlen(path)+16);
+    int fd;
+
+    sprintf(name,"%s.runsXXXXXX",path);
+    fd = mkstemp(name);
+    if(fd>=0) unlink(name);
+    free(name);
+
+    return fd;
+}
+
+// sorts the keys of keySize bytes (4 or 8) of input into output using about
+// budget bytes of memory; returns 0, or -1 after printing the error
+int externalSort(const char * input, const char * output, int keySize, size_t budget) {
+    struct ioThread_t io;
+    struct runReader_t reader;
+    struct runWriter_t writer;
+    struct stat st;
+    int in, out, tmp, next, fd, error = 0;
+    long runs, i, k, groups, runKeys;
+    off_t * bounds, * merged;
+    size_t dim, got;
+    char * keys;
+
+    if(keySize!=4 && keySize!=8) {
+        printf("Keys must be of 4 or 8 bytes.\n");
+        return -1;
+    }
+
+    // run generation: the I/O buffers and a run, twice for Radix Sort
+    dim = budget/16/EXTERNAL_ALIGN*EXTERNAL_ALIGN;
+    if(dim>EXTERNAL_IO_MAX) dim = EXTERNAL_IO_MAX;
+    if(dim<EXTERNAL_ALIGN) {
+        printf("The memory budget is too small.\n");
+        return -1;
+    }
+    runKeys = (budget-4*dim)/(2*keySize);
+    if(runKeys>INT_MAX) runKeys = INT_MAX;
+
+    if((in = open(input,O_RDONLY))<0) {
+        perror(input);
+        return -1;
+    }
+    if(fstat(in,&st)<0 || st.st_size%keySize!=0) {
+        printf("%s is not a file of %d byte keys.\n",input,keySize);
+        close(in);
+        return -1;
+    }
+    if((out = open(output,O_WRONLY|O_CREAT|O_TRUNC,0644))<0) {
+        perror(output);
+        close(in);
+        return -1;
+    }
+    if((tmp = externalTemp(output))<0) {
+        perror(output);
+        close(in);
+        close(out);
+        return -1;
+    }
+    posix_fadvise(in,0,0,POSIX_FADV_SEQUENTIAL);
+
+    ioStart(&io);
+
+    // a single run goes straight to the output
+    fd = st.st_size<=runKeys*keySize ? out : tmp;
+    keys = aligned_alloc(EXTERNAL_ALIGN,(runKeys*keySize+EXTERNAL_ALIGN-1)/EXTERNAL_ALIGN*EXTERNAL_ALIGN);
+    bounds = malloc(sizeof(off_t)*(st.st_size/keySize/runKeys+2));
+
+    runs = 0;
+    bounds[0] = 0;
+    readerOpen(&reader,&io,in,0,st.st_size,dim,keySize);
+    writerOpen(&writer,&io,fd,0,dim,keySize);
+    while((got = readerRead(&reader,keys,runKeys*keySize))>0) {
+        if(keySize==4) radixSort((int *)keys,got/4);
+        else radixSort64((int64_t *)keys,got/8);
+        writerWrite(&writer,keys,got);
+        runs++;
+        bounds[runs] = bounds[runs-1]+got;
+    }
+    if(readerClose(&reader) || writerClose(&writer)) error = 1;
+    free(keys);
+    close(in);
+
+    // merge passes: each run gets two buffers, and the output two more
+    while(!error && runs>1) {
+        dim = budget/(2*(runs+1))/EXTERNAL_ALIGN*EXTERNAL_ALIGN;
+        if(dim>EXTERNAL_IO_MAX) dim = EXTERNAL_IO_MAX;
+        if(dim<EXTERNAL_IO_MIN) dim = EXTERNAL_IO_MIN;
+        next = budget/(2*dim)-1;
+        if(next<2) next = 2;
+
+        if(runs<=next) {
+            if(externalMerge(&io,tmp,bounds,runs,out,0,dim,keySize)) error = 1;
+            break;
+        }
+
+        // groups of next runs go to a new temporary file
+        if((fd = externalTemp(output))<0) {
+            perror(output);
+            error = 1;
+            break;
+        }
+        groups = (runs+next-1)/next;
+        merged = malloc(sizeof(off_t)*(groups+1));
+        merged[0] = 0;
+        for(i=0;i<groups && !error;i++) {
+            k = runs-i*next<next ? runs-i*next : next;
+            if(externalMerge(&io,tmp,&bounds[i*next],k,fd,merged[i],dim,keySize)) error = 1;
+            merged[i+1] = bounds[i*next+k];
+        }
+
+        close(tmp);
+        free(bounds);
+        tmp = fd;
+        bounds = merged;
+        runs = groups;
+    }
+
+    ioStop(&io);
+    free(bounds);
+    close(tmp);
+    if(fsync(out)<0 || close(out)<0) error = 1;
+
+    if(error) printf("Error while sorting %s into %s.\n",input,output);
+
+    return error ? -1 : 0;
+}
+
+#endif
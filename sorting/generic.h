@@ -0,0 +1,219 @@
+#ifndef H_SORTING_GENERIC
+#define H_SORTING_GENERIC
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Type generic sorts: SORT_DEFINE(Name,type,LESS) writes insertionSortName,
+ * heapSortName, introSortName and mergeSortName for arrays of type, where
+ * LESS(x,y) is an expression that is true when x goes strictly before y.
+ * LESS is a macro, so the comparison and the key extraction are compiled
+ * in the loops, while qsort calls its comparator through a pointer for
+ * every comparison; compareName is also defined, to pass to qsort/bsearch.
+ * - Time complexity: $O(n\log(n))$ in the worst case, for all of them
+ *   except Insertion Sort
+ * - Space complexity: $O(\log(n))$, $O(n)$ for Merge Sort
+ * - Stability: only Merge Sort (and Insertion Sort) are stable
+ * - Optimizations: Intro Sort is the one of algo.h, with the median of 3
+ *   or ninther pivot, the loop on the bigger side and the Heap Sort
+ *   fallback, but short partitions are sorted with Insertion Sort since the
+ *   sorting networks are only for int; the heap is binary and bottom-up,
+ *   as it is only the fallback; Merge Sort copies only the left half in
+ *   the buffer, and skips the merge when the two halves are already in order
+ */
+
+#define GENERIC_THRESHOLD 24
+#define GENERIC_NINTHER_THRESHOLD 128
+
+#define SORT_DEFINE(Name, type, LESS) \
+\
+int compare##Name(const void * p1, const void * p2) { \
+    return LESS(*(const type *)p2,*(const type *)p1) - LESS(*(const type *)p1,*(const type *)p2); \
+} \
+\
+void insertionSort##Name(type * a, long n) { \
+    long i, j; \
+    type tmp; \
+\
+    for(i=1;i<n;i++) { \
+        tmp = a[i]; \
+        for(j=i-1;j>=0 && LESS(tmp,a[j]);j--) a[j+1] = a[j]; \
+        a[j+1] = tmp; \
+    } \
+\
+    return; \
+} \
+\
+void siftDown##Name(type * h, long n, long i) { \
+    long start = i, child; \
+    type tmp = h[i]; \
+\
+    while((child = 2*i+1)+1 < n) { \
+        child += LESS(h[child],h[child+1]); \
+        h[i] = h[child]; \
+        i = child; \
+    } \
+    if(child<n) { \
+        h[i] = h[child]; \
+        i = child; \
+    } \
+\
+    while(i>start && LESS(h[(i-1)/2],tmp)) { \
+        h[i] = h[(i-1)/2]; \
+        i = (i-1)/2; \
+    } \
+    h[i] = tmp; \
+\
+    return; \
+} \
+\
+void heapSort##Name(type * a, long n) { \
+    long i; \
+    type tmp; \
+\
+    for(i=n/2-1;i>=0;i--) siftDown##Name(a,n,i); \
+\
+    for(i=n-1;i>0;i--) { \
+        tmp = a[0]; \
+        a[0] = a[i]; \
+        a[i] = tmp; \
+        siftDown##Name(a,i,0); \
+    } \
+\
+    return; \
+} \
+\
+void sort3##Name(type * x, type * y, type * z) { \
+    type tmp; \
+\
+    if(LESS(*y,*x)) { tmp = *x; *x = *y; *y = tmp; } \
+    if(LESS(*z,*y)) { tmp = *y; *y = *z; *z = tmp; } \
+    if(LESS(*y,*x)) { tmp = *x; *x = *y; *y = tmp; } \
+\
+    return; \
+} \
+\
+/* pivot in a[0], then Hoare partition: a[0..j] and a[j+1..n) */ \
+long partition##Name(type * a, long n) { \
+    long s = n/2, i = -1, j = n; \
+    type pivot, tmp; \
+\
+    if(n>GENERIC_NINTHER_THRESHOLD) { \
+        sort3##Name(&a[0],&a[s],&a[n-1]); \
+        sort3##Name(&a[1],&a[s-1],&a[n-2]); \
+        sort3##Name(&a[2],&a[s+1],&a[n-3]); \
+        sort3##Name(&a[s-1],&a[s],&a[s+1]); \
+    } \
+    else sort3##Name(&a[0],&a[s],&a[n-1]); \
+\
+    pivot = a[s]; \
+    a[s] = a[0]; \
+    a[0] = pivot; \
+\
+    while(1) { \
+        do i++; while(LESS(a[i],pivot)); \
+        do j--; while(LESS(pivot,a[j])); \
+\
+        if(i>=j) return j; \
+\
+        tmp = a[i]; \
+        a[i] = a[j]; \
+        a[j] = tmp; \
+    } \
+} \
+\
+void introSortLoop##Name(type * a, long n, int depth) { \
+    long pivot; \
+\
+    while(n>GENERIC_THRESHOLD) { \
+        if(depth==0) { \
+            heapSort##Name(a,n); \
+            return; \
+        } \
+        depth--; \
+\
+        pivot = partition##Name(a,n); \
+\
+        if(pivot+1 < n-pivot-1) { \
+            introSortLoop##Name(a,pivot+1,depth); \
+            a = &a[pivot+1]; \
+            n = n-pivot-1; \
+        } \
+        else { \
+            introSortLoop##Name(&a[pivot+1],n-pivot-1,depth); \
+            n = pivot+1; \
+        } \
+    } \
+\
+    insertionSort##Name(a,n); \
+\
+    return; \
+} \
+\
+void introSort##Name(type * a, long n) { \
+    int depth = 0; \
+\
+    for(long i=n;i>1;i>>=1) depth += 2; \
+\
+    introSortLoop##Name(a,n,depth); \
+\
+    return; \
+} \
+\
+void mergeSortLoop##Name(type * a, long n, type * buffer) { \
+    long half = n/2, i = 0, j = half, k = 0; \
+\
+    if(n<=GENERIC_THRESHOLD) { \
+        insertionSort##Name(a,n); \
+        return; \
+    } \
+\
+    mergeSortLoop##Name(a,half,buffer); \
+    mergeSortLoop##Name(&a[half],n-half,buffer); \
+\
+    if(!LESS(a[half],a[half-1])) return; \
+\
+    memcpy(buffer,a,sizeof(type)*half); \
+    while(i<half && j<n) { \
+        if(LESS(a[j],buffer[i])) a[k++] = a[j++]; \
+        else a[k++] = buffer[i++]; \
+    } \
+    while(i<half) a[k++] = buffer[i++]; \
+\
+    return; \
+} \
+\
+void mergeSort##Name(type * a, long n) { \
+    type * buffer = malloc(sizeof(type)*(n/2+1)); \
+\
+    mergeSortLoop##Name(a,n,buffer); \
+\
+    free(buffer); \
+\
+    return; \
+}
+
+#define SORT_LESS(x,y) ((x)<(y))
+
+// total order for floating point: NaNs go after every number
+#define SORT_FLOAT_LESS(x,y) ((x)<(y) || ((y)!=(y) && (x)==(x)))
+
+// a key with a payload that moves with it, ordered by key only
+struct record_t {
+    int64_t key;
+    int64_t payload;
+};
+
+#define SORT_RECORD_LESS(x,y) ((x).key<(y).key)
+
+SORT_DEFINE(Int32, int32_t, SORT_LESS)
+SORT_DEFINE(Uint32, uint32_t, SORT_LESS)
+SORT_DEFINE(Int64, int64_t, SORT_LESS)
+SORT_DEFINE(Uint64, uint64_t, SORT_LESS)
+SORT_DEFINE(Float, float, SORT_FLOAT_LESS)
+SORT_DEFINE(Double, double, SORT_FLOAT_LESS)
+SORT_DEFINE(Record, struct record_t, SORT_RECORD_LESS)
+
+#endif
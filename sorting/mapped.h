@@ -0,0 +1,105 @@
+#ifndef H_SORTING_MAPPED
+#define H_SORTING_MAPPED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "algo.h"
+#include "generic.h"
+
+/*
+ * Mapped Sort sorts a binary file of 32 or 64 bit signed keys where it is,
+ * through a shared mapping of the file, so there is no copy of it in our
+ * memory besides the page cache, and msyncs it at the end:
+ * - Time complexity: $O(n\log(n))$ in place, with Intro Sort, $O(n)$ with a
+ *   scratch mapping, with Radix Sort
+ * - Space complexity: $O(\log(n))$ in place, an anonymous mapping as big as
+ *   the file with the scratch
+ * - Stability: No
+ * - Optimizations: the mappings are populated when they are made
+ *   (MAP_POPULATE), so the sort does not stop on a page fault every 4kB;
+ *   with MAPPED_HUGE we advise huge pages (MADV_HUGEPAGE) for fewer TLB
+ *   misses, which the scratch mapping gets, and the file too if its
+ *   filesystem supports them; lengths are 64 bits, so files can have more
+ *   than 2^31 keys
+ */
+
+#define MAPPED_SCRATCH 1 //Radix Sort through an anonymous mapping
+#define MAPPED_HUGE 2 //advise huge pages
+
+// maps size bytes of fd, or anonymous memory if fd<0, NULL if it cannot
+void * mappedMap(int fd, size_t size, int flags) {
+    void * map;
+
+    if(fd>=0) map = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,0);
+    else map = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE,-1,0);
+    if(map==MAP_FAILED) return NULL;
+
+    // only advice, it fails on filesystems without huge pages
+    if(flags&MAPPED_HUGE) madvise(map,size,MADV_HUGEPAGE);
+
+    return map;
+}
+
+int mappedSort(const char * path, int keySize, int flags) {
+    struct stat st;
+    void * keys, * scratch = NULL;
+    long n;
+    int fd, error = 0;
+
+    if(keySize!=4 && keySize!=8) {
+        printf("Keys must be of 4 or 8 bytes.\n");
+        return -1;
+    }
+
+    if((fd = open(path,O_RDWR))<0) {
+        perror(path);
+        return -1;
+    }
+    if(fstat(fd,&st)<0 || st.st_size%keySize!=0) {
+        printf("%s is not a file of %d byte keys.\n",path,keySize);
+        close(fd);
+        return -1;
+    }
+    n = st.st_size/keySize;
+    if(n<2) {
+        close(fd);
+        return 0;
+    }
+
+    if((keys = mappedMap(fd,st.st_size,flags))==NULL) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if((flags&MAPPED_SCRATCH) && (scratch = mappedMap(-1,st.st_size,flags))==NULL) {
+        perror("scratch mapping");
+        munmap(keys,st.st_size);
+        close(fd);
+        return -1;
+    }
+
+    if(scratch!=NULL) {
+        if(keySize==4) radixSortBuffer(keys,n,scratch);
+        else radixSort64Buffer(keys,n,scratch);
+        munmap(scratch,st.st_size);
+    }
+    else {
+        if(keySize==4) introSortInt32(keys,n);
+        else introSortInt64(keys,n);
+    }
+
+    if(msync(keys,st.st_size,MS_SYNC)<0) {
+        perror(path);
+        error = -1;
+    }
+    munmap(keys,st.st_size);
+    close(fd);
+
+    return error;
+}
+
+#endif
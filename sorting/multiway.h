@@ -0,0 +1,227 @@
+#ifndef H_SORTING_MULTIWAY
+#define H_SORTING_MULTIWAY
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "algo.h"
+
+/*
+ * Multiway Merge Sort sorts blocks that fit the L2 cache, then merges k of
+ * them at a time with a tournament tree, so it goes over the memory
+ * $1+\lceil\log_k(n/B)\rceil$ times instead of the $\log_2(n)$ of the
+ * binary Merge Sort, with B the block:
+ * - Time complexity: $O(n\log(n))$, $\log_2(k)$ comparisons per element in
+ *   every merge pass
+ * - Space complexity: $O(n)$
+ * - Stability: No, the blocks are sorted by pdqsort
+ * - Optimizations: the caches are read once with sysconf, or from sysfs
+ *   where sysconf does not know them; the block is half of the L2, and k is
+ *   the largest power of 2 such that a line of every run and the tree fit
+ *   the L1, then lowered so that the passes are balanced; the tree is a
+ *   loser tree of 64 bit players, the key and the run together, so a match
+ *   is a branchless min and max, and the nodes on the path of a replay are
+ *   known before it starts; the runs alternate between the array and one
+ *   buffer, and when the merge passes are odd the blocks are sorted in the
+ *   buffer, so the last pass ends in the array without a copy
+ */
+
+#define MULTIWAY_MIN_FANOUT 2
+#define MULTIWAY_MAX_FANOUT 1024
+
+struct cacheInfo_t {
+    long line;
+    long l1; //data
+    long l2;
+    long l3;
+};
+
+struct cacheInfo_t cacheInfo = {64,32<<10,256<<10,8<<20}; //if all fails
+
+pthread_once_t cacheInfoOnce = PTHREAD_ONCE_INIT;
+
+// size in bytes of the data or unified cache of a level from sysfs, 0 if
+// it is not there
+long cacheSysfs(int level, char * file) {
+    char path[96], type[32];
+    long value = 0, l;
+    int i;
+    char unit = 0;
+    FILE * f;
+
+    for(i=0;i<16;i++) {
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu0/cache/index%d/level",i);
+        if((f = fopen(path,"r"))==NULL) break;
+        l = fscanf(f,"%ld",&l)==1 ? l : 0;
+        fclose(f);
+        if(l!=level) continue;
+
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu0/cache/index%d/type",i);
+        if((f = fopen(path,"r"))==NULL) continue;
+        if(fscanf(f,"%31s",type)!=1) type[0] = 0;
+        fclose(f);
+        if(strcmp(type,"Instruction") == 0) continue;
+
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu0/cache/index%d/%s",i,file);
+        if((f = fopen(path,"r"))==NULL) continue;
+        if(fscanf(f,"%ld%c",&value,&unit)<1) value = 0;
+        fclose(f);
+        if(unit=='K') value <<= 10;
+        if(unit=='M') value <<= 20;
+        break;
+    }
+
+    return value;
+}
+
+void cacheDetect(void) {
+    long value;
+
+    if((value = sysconf(_SC_LEVEL1_DCACHE_LINESIZE))>0 || (value = cacheSysfs(1,"coherency_line_size"))>0)
+        cacheInfo.line = value;
+    if((value = sysconf(_SC_LEVEL1_DCACHE_SIZE))>0 || (value = cacheSysfs(1,"size"))>0)
+        cacheInfo.l1 = value;
+    if((value = sysconf(_SC_LEVEL2_CACHE_SIZE))>0 || (value = cacheSysfs(2,"size"))>0)
+        cacheInfo.l2 = value;
+    if((value = sysconf(_SC_LEVEL3_CACHE_SIZE))>0 || (value = cacheSysfs(3,"size"))>0)
+        cacheInfo.l3 = value;
+
+    return;
+}
+
+struct multiwayStats_t {
+    long block; //elements
+    int fanout;
+    int passes; //over the memory, the sort of the blocks included
+    double bytesPerElement; //read and written
+};
+
+// the tree plays keys and runs together, the key in the high half, so a
+// match is a min and a max of 64 bit ints; a run that is over plays
+// MULTIWAY_DONE, which loses against every key
+#define MULTIWAY_DONE INT64_MAX
+#define MULTIWAY_EMPTY (-1) //a node that no one reached yet, run 2^32-1
+#define MULTIWAY_PLAYER(key,run) ((int64_t)((uint64_t)(int64_t)(key)<<32|(uint32_t)(run)))
+
+int64_t multiwayNext(int * src, long * pos, long * bounds, int run) {
+    return pos[run]<bounds[run+1] ? MULTIWAY_PLAYER(src[pos[run]],run) : MULTIWAY_DONE;
+}
+
+// merges the k sorted runs [bounds[i],bounds[i+1]) of src in dst at bounds[0]
+void multiwayMerge(int * src, long * bounds, int k, int * dst, int64_t * tree, long * pos) {
+    int64_t winner, player;
+    int i, node, leaves, run;
+    long out, end;
+
+    for(leaves=1;leaves<k;leaves<<=1);
+
+    // the leaves past k are empty runs; the leaves play up in order, and
+    // at every node the winner of the left subtree waits for the right one
+    for(node=0;node<leaves;node++) tree[node] = MULTIWAY_EMPTY;
+    for(i=0;i<leaves;i++) {
+        pos[i] = i<k ? bounds[i] : 0;
+        winner = i<k ? multiwayNext(src,pos,bounds,i) : MULTIWAY_DONE;
+        for(node=(i+leaves)/2;node>0 && tree[node]!=MULTIWAY_EMPTY;node/=2) {
+            player = tree[node];
+            tree[node] = player>winner ? player : winner;
+            winner = player>winner ? winner : player;
+        }
+        tree[node] = winner;
+    }
+
+    winner = tree[0];
+    end = bounds[k];
+    for(out=bounds[0];out<end;out++) {
+        run = (uint32_t)winner;
+        dst[out] = (int)(winner>>32);
+        pos[run]++;
+        winner = multiwayNext(src,pos,bounds,run);
+
+        for(node=(run+leaves)/2;node>0;node/=2) {
+            player = tree[node];
+            tree[node] = player>winner ? player : winner;
+            winner = player>winner ? winner : player;
+        }
+    }
+
+    return;
+}
+
+void multiwayMergeSortStats(int * a, int n, struct multiwayStats_t * stats) {
+    int * b, * src, * dst, * swp, k, maxK, passes, i, g;
+    long block, runs, r, * bounds, * pos, lo, len;
+    int64_t * tree;
+
+    pthread_once(&cacheInfoOnce,cacheDetect);
+
+    block = cacheInfo.l2/2/sizeof(int);
+    for(maxK=MULTIWAY_MIN_FANOUT;
+            maxK<MULTIWAY_MAX_FANOUT && 2*maxK*(cacheInfo.line+(long)sizeof(int64_t))<=cacheInfo.l1;
+            maxK<<=1);
+
+    runs = n>0 ? (n+block-1)/block : 0;
+    for(passes=0,r=runs;r>1;passes++) r = (r+maxK-1)/maxK;
+    // the smallest k that still needs only these passes
+    for(k=MULTIWAY_MIN_FANOUT,r=1;passes>0;k++) {
+        for(i=0,r=1;i<passes && r<runs;i++) r *= k;
+        if(r>=runs) break;
+    }
+
+    if(stats!=NULL) {
+        stats->block = block;
+        stats->fanout = passes>0 ? k : 1;
+        stats->passes = 1+passes;
+        stats->bytesPerElement = 2*sizeof(int)*stats->passes;
+    }
+
+    if(n<2) return;
+    if(runs==1) {
+        pdqSort(a,n);
+        return;
+    }
+
+    b = malloc(sizeof(int)*n);
+    bounds = malloc(sizeof(long)*(k+1));
+    pos = malloc(sizeof(long)*2*k);
+    tree = malloc(sizeof(int64_t)*2*k);
+
+    // with odd passes the blocks go to the buffer, so that the last pass
+    // writes the array
+    src = passes%2 ? b : a;
+    dst = passes%2 ? a : b;
+    for(lo=0;lo<n;lo+=block) {
+        len = n-lo<block ? n-lo : block;
+        if(src!=a) memcpy(&src[lo],&a[lo],sizeof(int)*len);
+        pdqSort(&src[lo],len);
+    }
+
+    for(len=block;len<n;len*=k) {
+        for(lo=0;lo<n;lo+=len*k) {
+            for(g=0;g<k && lo+g*len<n;g++) bounds[g] = lo+g*len;
+            bounds[g] = lo+(long)g*len<n ? lo+(long)g*len : n;
+            if(g==1) memcpy(&dst[lo],&src[lo],sizeof(int)*(bounds[1]-lo));
+            else multiwayMerge(src,bounds,g,dst,tree,pos);
+        }
+        swp = src;
+        src = dst;
+        dst = swp;
+    }
+
+    free(b);
+    free(bounds);
+    free(pos);
+    free(tree);
+
+    return;
+}
+
+void multiwayMergeSort(int * a, int n) {
+    multiwayMergeSortStats(a,n,NULL);
+
+    return;
+}
+
+#endif
@@ -0,0 +1,569 @@
+#ifndef H_SORTING_PARALLEL
+#define H_SORTING_PARALLEL
+
+#include <stdlib.h>
+#include <string.h>
+#include "algo.h"
+#include "pool.h"
+
+#define PARALLEL_GRAIN 65536 //below this, sorts and merges are sequential
+
+/*
+ * Parallel Merge Sort sorts the two halves in parallel, then merges them in
+ * parallel too, splitting the output in pieces that are merged independently:
+ * - Time complexity: $O(n\log(n)/p)$ work per thread, $O(\log^3(n))$ span
+ * - Space complexity: $O(n)$
+ * - Stability: Yes
+ * - Optimizations: the levels alternate the array and the buffer like
+ *   Natural Merge Sort, which also sorts the leaves; the start of each piece
+ *   of the output in the two halves is found by co-ranking, a binary search
+ *   on both, so the pieces need no synchronization
+ */
+
+// merges a[0..na) and b[0..nb) in out, taking from b only when smaller
+void mergeArrays(int * a, int na, int * b, int nb, int * out) {
+    int i = 0, j = 0, takeRight;
+
+    while(i<na && j<nb) {
+        takeRight = b[j]<a[i];
+        *out++ = takeRight ? b[j] : a[i];
+        j += takeRight;
+        i += 1-takeRight;
+    }
+    memcpy(out,&a[i],sizeof(int)*(na-i));
+    memcpy(out+na-i,&b[j],sizeof(int)*(nb-j));
+
+    return;
+}
+
+// how many of the first k elements of the stable merge of a[0..na) and
+// b[0..nb) come from a
+int coRank(int k, int * a, int na, int * b, int nb) {
+    int i, j, low, high, mid;
+
+    low = k>nb ? k-nb : 0;
+    high = k<na ? k : na;
+
+    // the answer is the first i such that a[i] comes after b[k-i-1]
+    while(low<high) {
+        mid = low+(high-low)/2;
+        j = k-mid;
+        if(j>0 && mid<na && b[j-1]>=a[mid]) low = mid+1;
+        else high = mid;
+    }
+    i = low;
+
+    return i;
+}
+
+struct mergeTask_t {
+    int * src; //halves src[0..mid) and src[mid..n)
+    int * dst;
+    int mid, n;
+    int begin, end; //piece of the output
+};
+
+void parallelMergeTask(void * arg) {
+    struct mergeTask_t * t = arg, left, right;
+    struct poolTask_t task;
+    atomic_int group;
+    int i0, i1, half;
+
+    if(t->end-t->begin>PARALLEL_GRAIN) {
+        half = t->begin+(t->end-t->begin)/2;
+        left = right = *t;
+        left.end = half;
+        right.begin = half;
+
+        atomic_init(&group,0);
+        poolSpawn(&task,&parallelMergeTask,&left,&group);
+        parallelMergeTask(&right);
+        poolWait(&group);
+
+        return;
+    }
+
+    i0 = coRank(t->begin,t->src,t->mid,&t->src[t->mid],t->n-t->mid);
+    i1 = coRank(t->end,t->src,t->mid,&t->src[t->mid],t->n-t->mid);
+    mergeArrays(&t->src[i0],i1-i0,&t->src[t->mid+t->begin-i0],
+            (t->end-i1)-(t->begin-i0),&t->dst[t->begin]);
+
+    return;
+}
+
+struct mergeSortTask_t {
+    int * a;
+    int * b;
+    int n;
+    int intoBuffer; //whether the result goes to b instead of a
+};
+
+void parallelMergeSortTask(void * arg) {
+    struct mergeSortTask_t * t = arg, left, right;
+    struct mergeTask_t merge;
+    struct poolTask_t task;
+    atomic_int group;
+    int half = t->n/2;
+
+    if(t->n<=PARALLEL_GRAIN) {
+        naturalMergeSort(t->a,t->n);
+        if(t->intoBuffer) memcpy(t->b,t->a,sizeof(int)*t->n);
+        return;
+    }
+
+    // the halves go to the other array, so that merging them moves them back
+    left.a = t->a;
+    left.b = t->b;
+    left.n = half;
+    left.intoBuffer = !t->intoBuffer;
+    right.a = &t->a[half];
+    right.b = &t->b[half];
+    right.n = t->n-half;
+    right.intoBuffer = !t->intoBuffer;
+
+    atomic_init(&group,0);
+    poolSpawn(&task,&parallelMergeSortTask,&left,&group);
+    parallelMergeSortTask(&right);
+    poolWait(&group);
+
+    merge.src = t->intoBuffer ? t->a : t->b;
+    merge.dst = t->intoBuffer ? t->b : t->a;
+    merge.mid = half;
+    merge.n = t->n;
+    merge.begin = 0;
+    merge.end = t->n;
+    parallelMergeTask(&merge);
+
+    return;
+}
+
+void parallelMergeSort(struct pool_t * pool, int * a, int n) {
+    struct mergeSortTask_t t;
+
+    t.a = a;
+    t.b = malloc(sizeof(int)*n);
+    t.n = n;
+    t.intoBuffer = 0;
+
+    poolRun(pool,&parallelMergeSortTask,&t);
+
+    free(t.b);
+
+    return;
+}
+
+/*
+ * Parallel Sample Sort picks splitters from a sample of the array, moves
+ * every element in the bucket between two splitters, then sorts the buckets
+ * in parallel:
+ * - Time complexity: $O(n\log(n)/p)$ work per thread if the buckets are even
+ * - Space complexity: $O(n)$
+ * - Stability: No
+ * - Optimizations: the sample has SAMPLE_OVERSAMPLING elements per bucket,
+ *   so buckets are even with high probability; each block of the array
+ *   finds the buckets of its elements with a branchless binary search and
+ *   counts them, so the scatter is a stable parallel counting sort where
+ *   every block writes to its own part of every bucket
+ */
+
+#define SAMPLE_OVERSAMPLING 32
+#define SAMPLE_MAX_BUCKETS 256
+#define SAMPLE_BLOCKS_PER_THREAD 4
+
+struct sampleSort_t {
+    int * a;
+    int * b;
+    int n;
+    int buckets; //power of 2
+    int blocks;
+    int * splitters; //splitters[k] is the first value of bucket k+1
+    unsigned char * bucket; //bucket of every element
+    int * count; //count[block*buckets+k], then where the block writes
+    int * start; //start of every bucket, and n at the end
+};
+
+struct sampleTask_t {
+    struct sampleSort_t * s;
+    int index; //block or bucket
+};
+
+int sampleBucket(int * splitters, int buckets, int x) {
+    int k = 0, step;
+
+    for(step=buckets/2;step>0;step>>=1) k += step & -(splitters[k+step-1]<=x);
+
+    return k;
+}
+
+void sampleClassifyTask(void * arg) {
+    struct sampleSort_t * s = ((struct sampleTask_t *)arg)->s;
+    int block = ((struct sampleTask_t *)arg)->index;
+    int i, k, * count = &s->count[block*s->buckets];
+    long lo = (long)s->n*block/s->blocks, hi = (long)s->n*(block+1)/s->blocks;
+
+    for(k=0;k<s->buckets;k++) count[k] = 0;
+
+    for(i=lo;i<hi;i++) {
+        k = sampleBucket(s->splitters,s->buckets,s->a[i]);
+        s->bucket[i] = k;
+        count[k]++;
+    }
+
+    return;
+}
+
+void sampleScatterTask(void * arg) {
+    struct sampleSort_t * s = ((struct sampleTask_t *)arg)->s;
+    int block = ((struct sampleTask_t *)arg)->index;
+    int i, * offset = &s->count[block*s->buckets];
+    long lo = (long)s->n*block/s->blocks, hi = (long)s->n*(block+1)/s->blocks;
+
+    for(i=lo;i<hi;i++) s->b[offset[s->bucket[i]]++] = s->a[i];
+
+    return;
+}
+
+void sampleBucketTask(void * arg) {
+    struct sampleSort_t * s = ((struct sampleTask_t *)arg)->s;
+    int k = ((struct sampleTask_t *)arg)->index;
+    int lo = s->start[k], n = s->start[k+1]-lo;
+
+    pdqSort(&s->b[lo],n);
+    memcpy(&s->a[lo],&s->b[lo],sizeof(int)*n);
+
+    return;
+}
+
+void parallelSampleSortTask(void * arg) {
+    struct sampleSort_t * s = arg;
+    struct sampleTask_t * tasks;
+    int i, k, sum, samples, * sample;
+    unsigned int seed = 1;
+
+    samples = s->buckets*SAMPLE_OVERSAMPLING;
+    sample = malloc(sizeof(int)*samples);
+    for(i=0;i<samples;i++) {
+        seed = seed*1103515245u+12345u;
+        sample[i] = s->a[((unsigned long)seed*s->n)>>32];
+    }
+    pdqSort(sample,samples);
+    for(k=0;k<s->buckets-1;k++) s->splitters[k] = sample[(k+1)*SAMPLE_OVERSAMPLING];
+    free(sample);
+
+    tasks = malloc(sizeof(struct sampleTask_t)*(s->blocks>s->buckets ? s->blocks : s->buckets));
+    for(i=0;i<s->blocks || i<s->buckets;i++) {
+        tasks[i].s = s;
+        tasks[i].index = i;
+    }
+
+    poolFor(&sampleClassifyTask,tasks,sizeof(struct sampleTask_t),s->blocks);
+
+    // bucket by bucket, every block writes after the previous ones
+    sum = 0;
+    for(k=0;k<s->buckets;k++) {
+        s->start[k] = sum;
+        for(i=0;i<s->blocks;i++) {
+            samples = s->count[i*s->buckets+k];
+            s->count[i*s->buckets+k] = sum;
+            sum += samples;
+        }
+    }
+    s->start[s->buckets] = sum;
+
+    poolFor(&sampleScatterTask,tasks,sizeof(struct sampleTask_t),s->blocks);
+    poolFor(&sampleBucketTask,tasks,sizeof(struct sampleTask_t),s->buckets);
+
+    free(tasks);
+
+    return;
+}
+
+void parallelSampleSort(struct pool_t * pool, int * a, int n) {
+    struct sampleSort_t s;
+
+    if(n<=PARALLEL_GRAIN) {
+        pdqSort(a,n);
+        return;
+    }
+
+    s.a = a;
+    s.n = n;
+    s.blocks = pool->threads*SAMPLE_BLOCKS_PER_THREAD;
+    for(s.buckets=2;s.buckets<8*pool->threads && s.buckets<SAMPLE_MAX_BUCKETS;s.buckets*=2);
+    s.b = malloc(sizeof(int)*n);
+    s.splitters = malloc(sizeof(int)*s.buckets);
+    s.bucket = malloc(n);
+    s.count = malloc(sizeof(int)*s.blocks*s.buckets);
+    s.start = malloc(sizeof(int)*(s.buckets+1));
+
+    poolRun(pool,&parallelSampleSortTask,&s);
+
+    free(s.b);
+    free(s.splitters);
+    free(s.bucket);
+    free(s.count);
+    free(s.start);
+
+    return;
+}
+
+/*
+ * Parallel Counting Sort finds the range of the keys, then every thread
+ * counts its part of the array in a private histogram, and the histograms
+ * are summed into the start of every value with a parallel prefix sum:
+ * - Time complexity: $O((n+k)/p)$ per thread, with k the range of the keys
+ * - Space complexity: $O(pk)$, and $O(n)$ more for the stable version
+ * - Stability: No, the stable version writes every block of the array
+ *   after the previous blocks in the part of each value
+ * - Optimizations: the range is found with a parallel min/max scan, so no
+ *   domain has to be given, and when it is too wide for the histograms we
+ *   use Radix Sort; the prefix sum splits the values in chunks, sums the
+ *   chunks in parallel, scans the few chunk totals, and then every chunk
+ *   finishes its own values; with small domains the stable scatter goes
+ *   through write-combining buffers of a cache line per value, so the
+ *   writes to the array are full lines
+ */
+
+#define COUNTING_MAX_DOMAIN (1<<20)
+#define COUNTING_CHUNKS_PER_THREAD 4
+#define COUNTING_WC_DOMAIN 1024 //largest domain for write-combining
+#define COUNTING_WC_DIM 16 //ints in a cache line
+
+struct countingSort_t {
+    int * a;
+    int * b;
+    int n;
+    int blocks;
+    int chunks;
+    int min;
+    int domain;
+    int * minOf; //of every block
+    int * maxOf;
+    int * count; //count[block*domain+v], then where the block writes v
+    int * start; //start of every value, and n at the end
+    int * chunkTotal;
+};
+
+struct countingTask_t {
+    struct countingSort_t * s;
+    int index; //block or chunk
+};
+
+void countingRangeTask(void * arg) {
+    struct countingSort_t * s = ((struct countingTask_t *)arg)->s;
+    int block = ((struct countingTask_t *)arg)->index;
+    int i, min = INT_MAX, max = INT_MIN;
+    long lo = (long)s->n*block/s->blocks, hi = (long)s->n*(block+1)/s->blocks;
+
+    for(i=lo;i<hi;i++) {
+        min = s->a[i]<min ? s->a[i] : min;
+        max = s->a[i]>max ? s->a[i] : max;
+    }
+    s->minOf[block] = min;
+    s->maxOf[block] = max;
+
+    return;
+}
+
+void countingHistogramTask(void * arg) {
+    struct countingSort_t * s = ((struct countingTask_t *)arg)->s;
+    int block = ((struct countingTask_t *)arg)->index;
+    int i, min = s->min, * a = s->a, * count = &s->count[(long)block*s->domain];
+    long lo = (long)s->n*block/s->blocks, hi = (long)s->n*(block+1)/s->blocks;
+
+    memset(count,0,sizeof(int)*s->domain);
+    for(i=lo;i<hi;i++) count[a[i]-min]++;
+
+    return;
+}
+
+void countingChunkSumTask(void * arg) {
+    struct countingSort_t * s = ((struct countingTask_t *)arg)->s;
+    int chunk = ((struct countingTask_t *)arg)->index;
+    int v, block, sum = 0;
+    long lo = (long)s->domain*chunk/s->chunks, hi = (long)s->domain*(chunk+1)/s->chunks;
+
+    for(block=0;block<s->blocks;block++)
+        for(v=lo;v<hi;v++) sum += s->count[(long)block*s->domain+v];
+    s->chunkTotal[chunk] = sum;
+
+    return;
+}
+
+// needs chunkTotal to hold where the chunk starts
+void countingChunkPrefixTask(void * arg) {
+    struct countingSort_t * s = ((struct countingTask_t *)arg)->s;
+    int chunk = ((struct countingTask_t *)arg)->index;
+    int v, block, tmp, sum = s->chunkTotal[chunk];
+    long lo = (long)s->domain*chunk/s->chunks, hi = (long)s->domain*(chunk+1)/s->chunks;
+
+    for(v=lo;v<hi;v++) {
+        s->start[v] = sum;
+        for(block=0;block<s->blocks;block++) {
+            tmp = s->count[(long)block*s->domain+v];
+            s->count[(long)block*s->domain+v] = sum;
+            sum += tmp;
+        }
+    }
+
+    return;
+}
+
+void countingFillTask(void * arg) {
+    struct countingSort_t * s = ((struct countingTask_t *)arg)->s;
+    int chunk = ((struct countingTask_t *)arg)->index;
+    int v, i, end, value, * a = s->a;
+    long lo = (long)s->domain*chunk/s->chunks, hi = (long)s->domain*(chunk+1)/s->chunks;
+
+    for(v=lo;v<hi;v++) {
+        end = s->start[v+1];
+        value = s->min+v;
+        for(i=s->start[v];i<end;i++) a[i] = value;
+    }
+
+    return;
+}
+
+void countingScatterTask(void * arg) {
+    struct countingSort_t * s = ((struct countingTask_t *)arg)->s;
+    int block = ((struct countingTask_t *)arg)->index;
+    int i, v, x, f, min = s->min, * a = s->a, * b = s->b, * fill;
+    int * offset = &s->count[(long)block*s->domain];
+    int (* buffer)[COUNTING_WC_DIM];
+    long lo = (long)s->n*block/s->blocks, hi = (long)s->n*(block+1)/s->blocks;
+
+    if(s->domain>COUNTING_WC_DOMAIN) {
+        for(i=lo;i<hi;i++) b[offset[a[i]-min]++] = a[i];
+        return;
+    }
+
+    buffer = malloc(sizeof(*buffer)*(unsigned int)s->domain);
+    fill = calloc((unsigned int)s->domain,sizeof(int));
+
+    for(i=lo;i<hi;i++) {
+        x = a[i];
+        v = x-min;
+        f = fill[v];
+        buffer[v][f++] = x;
+        if(f==COUNTING_WC_DIM) {
+            memcpy(&b[offset[v]],buffer[v],sizeof(buffer[v]));
+            offset[v] += COUNTING_WC_DIM;
+            f = 0;
+        }
+        fill[v] = f;
+    }
+    for(v=0;v<s->domain;v++) memcpy(&b[offset[v]],buffer[v],sizeof(int)*fill[v]);
+
+    free(buffer);
+    free(fill);
+
+    return;
+}
+
+void countingCopyTask(void * arg) {
+    struct countingSort_t * s = ((struct countingTask_t *)arg)->s;
+    int block = ((struct countingTask_t *)arg)->index;
+    long lo = (long)s->n*block/s->blocks, hi = (long)s->n*(block+1)/s->blocks;
+
+    memcpy(&s->a[lo],&s->b[lo],sizeof(int)*(hi-lo));
+
+    return;
+}
+
+void parallelCountingSortTask(void * arg) {
+    struct countingSort_t * s = arg;
+    struct countingTask_t * tasks;
+    int i, sum, tmp, max;
+    long range;
+
+    tasks = malloc(sizeof(struct countingTask_t)*(s->blocks>s->chunks ? s->blocks : s->chunks));
+    for(i=0;i<s->blocks || i<s->chunks;i++) {
+        tasks[i].s = s;
+        tasks[i].index = i;
+    }
+
+    poolFor(&countingRangeTask,tasks,sizeof(struct countingTask_t),s->blocks);
+    s->min = INT_MAX;
+    max = INT_MIN;
+    for(i=0;i<s->blocks;i++) {
+        if(s->minOf[i]<s->min) s->min = s->minOf[i];
+        if(s->maxOf[i]>max) max = s->maxOf[i];
+    }
+
+    // too many values for the histograms
+    range = (long)max-s->min+1;
+    if(range>COUNTING_MAX_DOMAIN || range>s->n) {
+        s->domain = 0;
+        free(tasks);
+        return;
+    }
+
+    s->domain = range;
+    if(s->chunks>s->domain) s->chunks = s->domain;
+    s->count = malloc(sizeof(int)*s->blocks*s->domain);
+    s->start = malloc(sizeof(int)*(s->domain+1));
+
+    poolFor(&countingHistogramTask,tasks,sizeof(struct countingTask_t),s->blocks);
+    poolFor(&countingChunkSumTask,tasks,sizeof(struct countingTask_t),s->chunks);
+    sum = 0;
+    for(i=0;i<s->chunks;i++) {
+        tmp = s->chunkTotal[i];
+        s->chunkTotal[i] = sum;
+        sum += tmp;
+    }
+    poolFor(&countingChunkPrefixTask,tasks,sizeof(struct countingTask_t),s->chunks);
+    s->start[s->domain] = s->n;
+
+    if(s->b==NULL) poolFor(&countingFillTask,tasks,sizeof(struct countingTask_t),s->chunks);
+    else {
+        poolFor(&countingScatterTask,tasks,sizeof(struct countingTask_t),s->blocks);
+        poolFor(&countingCopyTask,tasks,sizeof(struct countingTask_t),s->blocks);
+    }
+
+    free(s->count);
+    free(s->start);
+    free(tasks);
+
+    return;
+}
+
+// returns 0 if the range of the keys is too wide for counting
+int parallelCounting(struct pool_t * pool, int * a, int n, int stable) {
+    struct countingSort_t s;
+
+    s.a = a;
+    s.b = stable ? malloc(sizeof(int)*n) : NULL;
+    s.n = n;
+    s.blocks = pool->threads;
+    s.chunks = pool->threads*COUNTING_CHUNKS_PER_THREAD;
+    s.minOf = malloc(sizeof(int)*s.blocks);
+    s.maxOf = malloc(sizeof(int)*s.blocks);
+    s.chunkTotal = malloc(sizeof(int)*s.chunks);
+
+    poolRun(pool,&parallelCountingSortTask,&s);
+
+    free(s.b);
+    free(s.minOf);
+    free(s.maxOf);
+    free(s.chunkTotal);
+
+    return s.domain>0;
+}
+
+void parallelCountingSort(struct pool_t * pool, int * a, int n) {
+    if(n<2) return;
+
+    if(!parallelCounting(pool,a,n,0)) radixSort(a,n);
+
+    return;
+}
+
+void parallelCountingStableSort(struct pool_t * pool, int * a, int n) {
+    if(n<2) return;
+
+    if(!parallelCounting(pool,a,n,1)) radixSort(a,n);
+
+    return;
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef H_SORTING_PERFCOUNT
+#define H_SORTING_PERFCOUNT
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/*
+ * Hardware counters of code regions, with perf_event_open: perfBegin takes
+ * a sample of the counters of the calling thread, and perfEnd adds what
+ * they counted since then to a region, so a region can collect many calls
+ * from many threads. perfPrint reports the totals of a region.
+ * Every thread opens its counters at its first perfBegin, one event at a
+ * time, so the events that the machine does not have (in containers and
+ * virtual machines often none of them) are reported as not available,
+ * and the others still work. The events are not a group, so the kernel
+ * can multiplex them when there are not enough counters; every delta is
+ * scaled by the time the event was enabled over the time it was counting.
+ */
+
+#define PERF_EVENTS 6
+
+struct perfEvent_t {
+    char * name;
+    uint32_t type;
+    uint64_t config;
+};
+
+#define PERF_CACHE_MISS(cache) \
+    ((cache)|(PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16))
+
+struct perfEvent_t perfEvents[PERF_EVENTS] = {
+    {"cycles",PERF_TYPE_HARDWARE,PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions",PERF_TYPE_HARDWARE,PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch misses",PERF_TYPE_HARDWARE,PERF_COUNT_HW_BRANCH_MISSES},
+    {"L1 data misses",PERF_TYPE_HW_CACHE,PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"LLC misses",PERF_TYPE_HW_CACHE,PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {"dTLB misses",PERF_TYPE_HW_CACHE,PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+// counters of the calling thread, -1 if not available, and why
+_Thread_local int perfFds[PERF_EVENTS];
+_Thread_local int perfErrors[PERF_EVENTS];
+_Thread_local int perfOpened = 0;
+
+struct perfSample_t {
+    uint64_t value[PERF_EVENTS];
+    uint64_t enabled[PERF_EVENTS];
+    uint64_t running[PERF_EVENTS];
+};
+
+struct perfRegion_t {
+    char * name;
+    atomic_ullong calls;
+    atomic_ullong count[PERF_EVENTS];
+    atomic_int counted[PERF_EVENTS]; //calls where the event was available
+    atomic_int error; //errno of the first event that could not be opened
+};
+
+#define PERF_REGION(regionName) { .name = (regionName) }
+
+void perfRegionInit(struct perfRegion_t * r, char * name) {
+    int e;
+
+    r->name = name;
+    atomic_init(&r->calls,0);
+    for(e=0;e<PERF_EVENTS;e++) {
+        atomic_init(&r->count[e],0);
+        atomic_init(&r->counted[e],0);
+    }
+    atomic_init(&r->error,0);
+
+    return;
+}
+
+void perfOpen(void) {
+    struct perf_event_attr attr;
+    int e;
+
+    for(e=0;e<PERF_EVENTS;e++) {
+        memset(&attr,0,sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perfEvents[e].type;
+        attr.config = perfEvents[e].config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // only user space, which is also what unprivileged users can count
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        perfFds[e] = syscall(SYS_perf_event_open,&attr,0,-1,-1,0);
+        perfErrors[e] = perfFds[e]<0 ? errno : 0;
+    }
+    perfOpened = 1;
+
+    return;
+}
+
+// closes the counters of the calling thread, before it exits
+void perfClose(void) {
+    int e;
+
+    if(!perfOpened) return;
+
+    for(e=0;e<PERF_EVENTS;e++) if(perfFds[e]>=0) close(perfFds[e]);
+    perfOpened = 0;
+
+    return;
+}
+
+void perfRead(struct perfSample_t * s) {
+    uint64_t buffer[3];
+    int e;
+
+    for(e=0;e<PERF_EVENTS;e++) {
+        if(perfFds[e]>=0 && read(perfFds[e],buffer,sizeof(buffer))==sizeof(buffer)) {
+            s->value[e] = buffer[0];
+            s->enabled[e] = buffer[1];
+            s->running[e] = buffer[2];
+        }
+        else s->enabled[e] = s->running[e] = s->value[e] = 0;
+    }
+
+    return;
+}
+
+void perfBegin(struct perfSample_t * s) {
+    if(!perfOpened) perfOpen();
+
+    perfRead(s);
+
+    return;
+}
+
+void perfEnd(struct perfRegion_t * r, struct perfSample_t * s) {
+    struct perfSample_t end;
+    double enabled, running;
+    int e, expected;
+
+    perfRead(&end);
+
+    atomic_fetch_add(&r->calls,1);
+    for(e=0;e<PERF_EVENTS;e++) {
+        if(perfFds[e]<0) {
+            expected = 0;
+            atomic_compare_exchange_strong(&r->error,&expected,perfErrors[e]);
+            continue;
+        }
+        enabled = end.enabled[e]-s->enabled[e];
+        running = end.running[e]-s->running[e];
+        if(running>0)
+            atomic_fetch_add(&r->count[e],(uint64_t)((end.value[e]-s->value[e])*(enabled/running)));
+        atomic_fetch_add(&r->counted[e],1);
+    }
+
+    return;
+}
+
+void perfPrint(struct perfRegion_t * r, FILE * out) {
+    unsigned long long count[PERF_EVENTS];
+    int e, available = 0;
+
+    for(e=0;e<PERF_EVENTS;e++) {
+        count[e] = atomic_load(&r->count[e]);
+        available |= atomic_load(&r->counted[e])>0;
+    }
+
+    if(atomic_load(&r->calls)==0) {
+        fprintf(out,"[%s] no calls\n\n",r->name);
+        return;
+    }
+
+    if(!available) {
+        fprintf(out,"[%s] performance counters not available: %s\n\n",r->name,
+                strerror(atomic_load(&r->error) ? atomic_load(&r->error) : ENOENT));
+        return;
+    }
+
+    fprintf(out,"[%s] performance counters of %llu calls:\n",r->name,
+            (unsigned long long)atomic_load(&r->calls));
+    for(e=0;e<PERF_EVENTS;e++) {
+        if(atomic_load(&r->counted[e])>0) fprintf(out,"%s: %llu\n",perfEvents[e].name,count[e]);
+        else fprintf(out,"%s: not available\n",perfEvents[e].name);
+    }
+    if(count[0]>0 && atomic_load(&r->counted[1])>0)
+        fprintf(out,"instructions per cycle: %.2f\n",(double)count[1]/count[0]);
+    fprintf(out,"\n");
+
+    return;
+}
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef H_SORTING_POOL
+#define H_SORTING_POOL
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ * Work stealing pool for fork-join tasks: every worker has a Chase-Lev deque,
+ * it pushes and pops the tasks it spawns at the bottom, while idle workers
+ * steal from the top of a random victim. The thread calling poolRun is
+ * worker 0, and a worker waiting for its tasks runs other tasks meanwhile.
+ * Tasks live in the frame of the spawner, which always waits for them.
+ */
+
+#define DEQUE_DIM 4096 //a task that does not fit runs inline
+
+struct poolTask_t {
+    void (* run)(void *);
+    void * arg;
+    atomic_int * group;
+};
+
+struct deque_t {
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+    _Atomic(struct poolTask_t *) tasks[DEQUE_DIM];
+};
+
+struct pool_t {
+    int threads;
+    struct deque_t * deques;
+    pthread_t * workers;
+    struct poolWorker_t * args;
+    pthread_mutex_t lock; //one poolRun at a time
+    pthread_mutex_t sleep;
+    pthread_cond_t wake;
+    atomic_int running;
+    atomic_int stop;
+};
+
+struct poolWorker_t {
+    struct pool_t * pool;
+    int id;
+};
+
+_Thread_local struct pool_t * poolCurrent = NULL;
+_Thread_local int poolWorker = 0;
+_Thread_local unsigned int poolSeed = 1;
+
+int dequePush(struct deque_t * d, struct poolTask_t * task) {
+    long b = atomic_load_explicit(&d->bottom,memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top,memory_order_acquire);
+
+    if(b-t>=DEQUE_DIM) return 0;
+
+    atomic_store_explicit(&d->tasks[b&(DEQUE_DIM-1)],task,memory_order_relaxed);
+    atomic_store_explicit(&d->bottom,b+1,memory_order_release);
+
+    return 1;
+}
+
+struct poolTask_t * dequePop(struct deque_t * d) {
+    long b = atomic_load_explicit(&d->bottom,memory_order_relaxed)-1;
+    long t;
+    struct poolTask_t * task = NULL;
+
+    atomic_store_explicit(&d->bottom,b,memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    t = atomic_load_explicit(&d->top,memory_order_relaxed);
+
+    if(t<=b) {
+        task = atomic_load_explicit(&d->tasks[b&(DEQUE_DIM-1)],memory_order_relaxed);
+        if(t==b) {
+            // last task, race with the thieves for it
+            if(!atomic_compare_exchange_strong_explicit(&d->top,&t,t+1,
+                        memory_order_seq_cst,memory_order_relaxed))
+                task = NULL;
+            atomic_store_explicit(&d->bottom,b+1,memory_order_relaxed);
+        }
+    }
+    else atomic_store_explicit(&d->bottom,b+1,memory_order_relaxed);
+
+    return task;
+}
+
+struct poolTask_t * dequeSteal(struct deque_t * d) {
+    long t = atomic_load_explicit(&d->top,memory_order_acquire);
+    long b;
+    struct poolTask_t * task;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    b = atomic_load_explicit(&d->bottom,memory_order_acquire);
+
+    if(t>=b) return NULL;
+
+    task = atomic_load_explicit(&d->tasks[t&(DEQUE_DIM-1)],memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&d->top,&t,t+1,
+                memory_order_seq_cst,memory_order_relaxed))
+        return NULL;
+
+    return task;
+}
+
+void poolRunTask(struct poolTask_t * task) {
+    task->run(task->arg);
+    atomic_fetch_sub_explicit(task->group,1,memory_order_release);
+
+    return;
+}
+
+struct poolTask_t * poolSteal(struct pool_t * pool) {
+    int i, victim;
+    struct poolTask_t * task;
+
+    poolSeed ^= poolSeed<<13;
+    poolSeed ^= poolSeed>>17;
+    poolSeed ^= poolSeed<<5;
+
+    for(i=0;i<pool->threads;i++) {
+        victim = (poolSeed+i)%pool->threads;
+        if(victim==poolWorker) continue;
+        if((task = dequeSteal(&pool->deques[victim]))!=NULL) return task;
+    }
+
+    return NULL;
+}
+
+void * poolWorkerLoop(void * arg) {
+    struct pool_t * pool = ((struct poolWorker_t *)arg)->pool;
+    struct poolTask_t * task;
+
+    poolCurrent = pool;
+    poolWorker = ((struct poolWorker_t *)arg)->id;
+    poolSeed = 2654435761u*(poolWorker+1);
+
+    while(1) {
+        pthread_mutex_lock(&pool->sleep);
+        while(!atomic_load(&pool->running) && !atomic_load(&pool->stop))
+            pthread_cond_wait(&pool->wake,&pool->sleep);
+        pthread_mutex_unlock(&pool->sleep);
+
+        if(atomic_load(&pool->stop)) break;
+
+        while(atomic_load_explicit(&pool->running,memory_order_relaxed)) {
+            if((task = poolSteal(pool))!=NULL) poolRunTask(task);
+            else sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+struct pool_t * poolCreate(int threads) {
+    int i;
+    struct pool_t * pool = malloc(sizeof(struct pool_t));
+
+    if(threads<1) threads = 1;
+
+    pool->threads = threads;
+    pool->deques = aligned_alloc(64,sizeof(struct deque_t)*threads);
+    pool->workers = malloc(sizeof(pthread_t)*threads);
+    pool->args = malloc(sizeof(struct poolWorker_t)*threads);
+    pthread_mutex_init(&pool->lock,NULL);
+    pthread_mutex_init(&pool->sleep,NULL);
+    pthread_cond_init(&pool->wake,NULL);
+    atomic_init(&pool->running,0);
+    atomic_init(&pool->stop,0);
+
+    for(i=0;i<threads;i++) {
+        atomic_init(&pool->deques[i].top,0);
+        atomic_init(&pool->deques[i].bottom,0);
+    }
+
+    for(i=1;i<threads;i++) {
+        pool->args[i].pool = pool;
+        pool->args[i].id = i;
+        pthread_create(&pool->workers[i],NULL,&poolWorkerLoop,&pool->args[i]);
+    }
+
+    return pool;
+}
+
+void poolDestroy(struct pool_t * pool) {
+    int i;
+
+    pthread_mutex_lock(&pool->sleep);
+    atomic_store(&pool->stop,1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleep);
+
+    for(i=1;i<pool->threads;i++) pthread_join(pool->workers[i],NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->sleep);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->args);
+    free(pool);
+
+    return;
+}
+
+// the task can be run by any worker until poolWait on its group returns;
+// outside of a pool it just runs inline
+void poolSpawn(struct poolTask_t * task, void (* run)(void *), void * arg, atomic_int * group) {
+    task->run = run;
+    task->arg = arg;
+    task->group = group;
+    atomic_fetch_add_explicit(group,1,memory_order_relaxed);
+
+    if(poolCurrent==NULL || !dequePush(&poolCurrent->deques[poolWorker],task))
+        poolRunTask(task);
+
+    return;
+}
+
+void poolWait(atomic_int * group) {
+    struct poolTask_t * task;
+
+    while(atomic_load_explicit(group,memory_order_acquire)>0) {
+        task = dequePop(&poolCurrent->deques[poolWorker]);
+        if(task==NULL) task = poolSteal(poolCurrent);
+        if(task!=NULL) poolRunTask(task);
+        else sched_yield();
+    }
+
+    return;
+}
+
+// runs run(arg) with the pool, and returns when it and its tasks are done
+void poolRun(struct pool_t * pool, void (* run)(void *), void * arg) {
+    pthread_mutex_lock(&pool->lock);
+
+    poolCurrent = pool;
+    poolWorker = 0;
+
+    pthread_mutex_lock(&pool->sleep);
+    atomic_store(&pool->running,1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleep);
+
+    run(arg);
+
+    atomic_store(&pool->running,0);
+    poolCurrent = NULL;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return;
+}
+
+// runs run on count arguments of size bytes each in parallel, and waits
+void poolFor(void (* run)(void *), void * args, size_t size, int count) {
+    int i;
+    atomic_int group;
+    struct poolTask_t * tasks = malloc(sizeof(struct poolTask_t)*count);
+
+    atomic_init(&group,0);
+    for(i=0;i<count;i++) poolSpawn(&tasks[i],run,(char *)args+i*size,&group);
+    poolWait(&group);
+
+    free(tasks);
+
+    return;
+}
+
+#endif
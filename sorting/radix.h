@@ -0,0 +1,109 @@
+#ifndef H_SORTING_RADIX
+#define H_SORTING_RADIX
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "algo.h"
+
+/*
+ * Type generic Radix Sort (LSD): RADIX_DEFINE(Name,type,keyType,KEY)
+ * writes radixSortNameBuffer and radixSortName for arrays of type, where
+ * KEY(x) is an unsigned int of keyType with the order in which x has to
+ * be sorted; the elements are moved, the keys are only computed, so they
+ * never have to be turned back:
+ * - Time complexity: $O(n\cdot b/RADIX\_BITS)$ for keys of b bits
+ * - Space complexity: $O(n)$
+ * - Stability: Yes
+ * - Optimizations: the ones of radixSort in algo.h, the histograms of all
+ *   the digits in one pass and the digits where all keys are equal skipped,
+ *   which on timestamps and on floats of a small range are most of them
+ * Floats are sorted by their bits with the sign flipped, and the other bits
+ * too for negative ones, that is the total order of IEEE 754: -NaN, -inf,
+ * negative numbers, -0, +0, positive numbers, +inf, +NaN.
+ */
+
+#define RADIX_DEFINE(Name, type, keyType, KEY) \
+\
+void radixSort##Name##Buffer(type * a, long n, type * b) { \
+    long i, idx, sum, count; \
+    int d, shift, digits = (sizeof(keyType)*8+RADIX_BITS-1)/RADIX_BITS; \
+    type * src, * dst, * swp; \
+    keyType key; \
+    long (* frequency)[RADIX_SIZE]; \
+\
+    if(n<2) return; \
+\
+    frequency = calloc(digits,sizeof(*frequency)); \
+\
+    for(i=0;i<n;i++) { \
+        key = KEY(a[i]); \
+        for(d=0;d<digits;d++) frequency[d][(key>>(d*RADIX_BITS))&(RADIX_SIZE-1)]++; \
+    } \
+\
+    src = a; \
+    dst = b; \
+    for(d=0;d<digits;d++) { \
+        shift = d*RADIX_BITS; \
+\
+        if(frequency[d][(KEY(src[0])>>shift)&(RADIX_SIZE-1)]==n) continue; \
+\
+        sum = 0; \
+        for(i=0;i<RADIX_SIZE;i++) { \
+            count = frequency[d][i]; \
+            frequency[d][i] = sum; \
+            sum += count; \
+        } \
+\
+        for(i=0;i<n;i++) { \
+            idx = frequency[d][(KEY(src[i])>>shift)&(RADIX_SIZE-1)]++; \
+            dst[idx] = src[i]; \
+        } \
+\
+        swp = src; \
+        src = dst; \
+        dst = swp; \
+    } \
+\
+    if(src!=a) memcpy(a,src,n*sizeof(type)); \
+\
+    free(frequency); \
+\
+    return; \
+} \
+\
+void radixSort##Name(type * a, long n) { \
+    type * b; \
+\
+    if(n<2) return; \
+\
+    b = malloc(n*sizeof(type)); \
+    radixSort##Name##Buffer(a,n,b); \
+    free(b); \
+\
+    return; \
+}
+
+static inline uint32_t radixFloatKey(float x) {
+    uint32_t u;
+
+    memcpy(&u,&x,sizeof(u));
+
+    return u^(-(u>>31)|0x80000000u);
+}
+
+static inline uint64_t radixDoubleKey(double x) {
+    uint64_t u;
+
+    memcpy(&u,&x,sizeof(u));
+
+    return u^(-(u>>63)|0x8000000000000000ull);
+}
+
+#define RADIX_SAME(x) (x)
+
+RADIX_DEFINE(Uint64, uint64_t, uint64_t, RADIX_SAME)
+RADIX_DEFINE(Float, float, uint32_t, radixFloatKey)
+RADIX_DEFINE(Double, double, uint64_t, radixDoubleKey)
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef H_SORTING_RECORDS
+#define H_SORTING_RECORDS
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "algo.h"
+#include "generic.h"
+
+/*
+ * Sorting records by an int key, with their payload or with the index
+ * permutation:
+ * - pairs keep a 32 or 64 bit payload next to the key, and are sorted with
+ *   introSortPairN (not stable), mergeSortPairN, radixSortPairN and
+ *   countingStableSortPairN (stable)
+ * - argSort and argCountingSort give the permutation that sorts the keys,
+ *   stable, and applyPermutation moves any number of arrays with it
+ * - Time complexity: $O(n)$ for the radix and counting ones, with 3 passes
+ *   on the keys, $O(n\log(n))$ for the others
+ * - Space complexity: $O(n)$, $O(\log(n))$ for Intro Sort
+ * - Optimizations: Radix Sort is the one of algo.h, but only on the 32 bits
+ *   of the key, whatever the size of the pair; argSort sorts (key, index)
+ *   pairs, so the index rides along and there is no gather by index until
+ *   the end; applyPermutation goes through the permutation in blocks of
+ *   PERMUTE_BLOCK indices, and moves each array with the same block,
+ *   which stays in L1, instead of reading the permutation once per array
+ */
+
+#define PERMUTE_BLOCK 2048
+
+struct pair32_t {
+    int key;
+    uint32_t value;
+};
+
+struct pair64_t {
+    int key;
+    uint64_t value;
+};
+
+#define PAIR_LESS(x,y) ((x).key<(y).key)
+
+SORT_DEFINE(Pair32, struct pair32_t, PAIR_LESS)
+SORT_DEFINE(Pair64, struct pair64_t, PAIR_LESS)
+
+#define PAIR_SORT_DEFINE(Name, type) \
+\
+void radixSort##Name(type * a, long n) { \
+    long i, idx, sum, count; \
+    int d, shift; \
+    type * b, * src, * dst, * swp; \
+    unsigned int key; \
+    long (* frequency)[RADIX_SIZE]; \
+\
+    if(n<2) return; \
+\
+    frequency = calloc(RADIX_DIGITS,sizeof(*frequency)); \
+    b = malloc(n*sizeof(type)); \
+\
+    for(i=0;i<n;i++) { \
+        key = RADIX_KEY(a[i].key); \
+        for(d=0;d<RADIX_DIGITS;d++) frequency[d][(key>>(d*RADIX_BITS))&(RADIX_SIZE-1)]++; \
+    } \
+\
+    src = a; \
+    dst = b; \
+    for(d=0;d<RADIX_DIGITS;d++) { \
+        shift = d*RADIX_BITS; \
+\
+        if(frequency[d][(RADIX_KEY(src[0].key)>>shift)&(RADIX_SIZE-1)]==n) continue; \
+\
+        sum = 0; \
+        for(i=0;i<RADIX_SIZE;i++) { \
+            count = frequency[d][i]; \
+            frequency[d][i] = sum; \
+            sum += count; \
+        } \
+\
+        for(i=0;i<n;i++) { \
+            idx = frequency[d][(RADIX_KEY(src[i].key)>>shift)&(RADIX_SIZE-1)]++; \
+            dst[idx] = src[i]; \
+        } \
+\
+        swp = src; \
+        src = dst; \
+        dst = swp; \
+    } \
+\
+    if(src!=a) memcpy(a,src,n*sizeof(type)); \
+\
+    free(frequency); \
+    free(b); \
+\
+    return; \
+} \
+\
+/* keys must be in [0,domain_size), like for countingStableSort */ \
+void countingStableSort##Name(type * a, long n, int domain_size) { \
+    long i, sum; \
+    long * cumulative = calloc(domain_size,sizeof(long)); \
+    type * b = malloc(n*sizeof(type)); \
+\
+    for(i=0;i<n;i++) cumulative[a[i].key]++; \
+\
+    sum = 0; \
+    for(i=0;i<domain_size;i++) { \
+        sum += cumulative[i]; \
+        cumulative[i] = sum; \
+    } \
+\
+    memcpy(b,a,n*sizeof(type)); \
+\
+    for(i=n-1;i>=0;i--) a[--cumulative[b[i].key]] = b[i]; \
+\
+    free(cumulative); \
+    free(b); \
+\
+    return; \
+}
+
+PAIR_SORT_DEFINE(Pair32, struct pair32_t)
+PAIR_SORT_DEFINE(Pair64, struct pair64_t)
+
+// perm[i] is the index of the i-th key in order, equal keys keep the order
+// they have in keys; n must be less than 2^32
+void argSort(const int * keys, long n, uint32_t * perm) {
+    long i;
+    struct pair32_t * pairs = malloc(n*sizeof(struct pair32_t));
+
+    for(i=0;i<n;i++) {
+        pairs[i].key = keys[i];
+        pairs[i].value = i;
+    }
+
+    radixSortPair32(pairs,n);
+
+    for(i=0;i<n;i++) perm[i] = pairs[i].value;
+
+    free(pairs);
+
+    return;
+}
+
+// argSort for keys in [0,domain_size): the indices are placed directly,
+// with no pairs to sort
+void argCountingSort(const int * keys, long n, uint32_t * perm, int domain_size) {
+    long i, sum;
+    long * cumulative = calloc(domain_size,sizeof(long));
+
+    for(i=0;i<n;i++) cumulative[keys[i]]++;
+
+    sum = 0;
+    for(i=0;i<domain_size;i++) {
+        sum += cumulative[i];
+        cumulative[i] = sum;
+    }
+
+    for(i=n-1;i>=0;i--) perm[--cumulative[keys[i]]] = i;
+
+    free(cumulative);
+
+    return;
+}
+
+// one array to move with applyPermutation: dst[i] = src[perm[i]]
+struct column_t {
+    const void * src;
+    void * dst;
+    size_t size;
+};
+
+// memcpy of a constant size, which compiles to plain moves but, unlike an
+// assignment of a type of that size, copies every byte, padding included,
+// and does not assume the alignment of the type
+#define PERMUTE_LOOP(bytes) \
+    for(i=start;i<end;i++) memcpy(dst+i*(bytes),src+(size_t)perm[i]*(bytes),bytes)
+
+void applyPermutation(const uint32_t * perm, long n, struct column_t * columns, int count) {
+    long start, end, i;
+    int c;
+    const char * src;
+    char * dst;
+    size_t size;
+
+    for(start=0;start<n;start=end) {
+        end = start+PERMUTE_BLOCK<n ? start+PERMUTE_BLOCK : n;
+
+        for(c=0;c<count;c++) {
+            src = columns[c].src;
+            dst = columns[c].dst;
+            size = columns[c].size;
+
+            // the common sizes get a copy of known size
+            if(size==4) PERMUTE_LOOP(4);
+            else if(size==8) PERMUTE_LOOP(8);
+            else if(size==16) PERMUTE_LOOP(16);
+            else PERMUTE_LOOP(size);
+        }
+    }
+
+    return;
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef H_SORTING_SELECT
+#define H_SORTING_SELECT
+
+#include <stdlib.h>
+#include <limits.h>
+#include "algo.h"
+#include "simd.h"
+
+/*
+ * Intro Select puts in a[k] the element that would be there if the array
+ * was sorted, with the smaller ones before it and the bigger ones after:
+ * - Time complexity: $O(n)$ also in the worst case
+ * - Space complexity: $O(\log(n))$, for the median of medians only
+ * - Stability: No
+ * - Optimizations: it is Intro Sort that keeps only the side with k, with
+ *   the same pivot and partition; after $2\log(n)$ partitions the pivot is
+ *   the median of the medians of groups of 5, which always leaves out a
+ *   fraction of the array, so the time stays linear; the last
+ *   SIMD_SMALL_DIM elements are sorted with the SIMD sorting network
+ */
+
+// moves to a[0] the median of the medians of the groups of 5 elements
+void medianOfMedians(int * a, int n);
+
+void introSelectLoop(int * a, int n, int k, int depth) {
+    int pivot;
+
+    while(n>SIMD_SMALL_DIM) {
+        if(depth>0) {
+            depth--;
+            choosePivot(a,n);
+        }
+        else medianOfMedians(a,n);
+
+        pivot = partition(a,n);
+
+        if(k<=pivot) n = pivot+1;
+        else {
+            a = &a[pivot+1];
+            k -= pivot+1;
+            n -= pivot+1;
+        }
+    }
+
+    simdSortSmall(a,n);
+
+    return;
+}
+
+void medianOfMedians(int * a, int n) {
+    int i, m = 0;
+
+    for(i=0;i+5<=n;i+=5) {
+        insertionSort(&a[i],5);
+        swapInt(&a[m++],&a[i+2]);
+    }
+
+    // the medians are in a[0..m), and their median goes to a[0]
+    introSelectLoop(a,m,m/2,0);
+    swapInt(&a[0],&a[m/2]);
+
+    return;
+}
+
+void introSelect(int * a, int n, int k) {
+    int depth = 0;
+
+    if(k<0 || k>=n) return;
+
+    for(int i=n;i>1;i>>=1) depth += 2;
+
+    introSelectLoop(a,n,k,depth);
+
+    return;
+}
+
+// the k smallest elements in order in a[0..k), the others after them
+void partialSort(int * a, int n, int k) {
+    if(k<=0) return;
+    if(k>=n) {
+        introSort(a,n);
+        return;
+    }
+
+    introSelect(a,n,k-1);
+    introSort(a,k-1);
+
+    return;
+}
+
+/*
+ * Streaming top-k keeps the k smallest elements seen so far in a max heap,
+ * the 4-ary one of Heap Sort, whose root is the threshold a new element has
+ * to beat:
+ * - Time complexity: $O(n\log(k))$ in the worst case, $O(n)$ when most
+ *   elements are filtered, as on random input, where the i-th element
+ *   enters the heap with probability k/i
+ * - Space complexity: $O(k)$, whatever the length of the stream
+ * - Optimizations: once the heap is full, the input is scanned with SIMD
+ *   comparisons against the threshold for the next element below it, so
+ *   the elements that are filtered cost a fraction of a comparison each
+ */
+
+struct topK_t {
+    int * heap;
+    int k;
+    int size;
+    long seen;
+};
+
+void topKInit(struct topK_t * t, int k) {
+    t->heap = malloc(sizeof(int)*(k>0 ? k : 1));
+    t->k = k;
+    t->size = 0;
+    t->seen = 0;
+
+    return;
+}
+
+void topKPush(struct topK_t * t, int * values, int n) {
+    int i = 0, j;
+
+    t->seen += n;
+    if(t->k<=0) return;
+
+    // the first k elements fill the heap
+    while(t->size<t->k && i<n) t->heap[t->size++] = values[i++];
+    if(t->size<t->k) return;
+    if(i>0) for(j=t->k>1 ? (t->k-2)/4 : -1;j>=0;j--) siftDown(t->heap,t->k,j);
+
+    while((i += simdFindLess(&values[i],n-i,t->heap[0]))<n) {
+        t->heap[0] = values[i++];
+        siftDown(t->heap,t->k,0);
+    }
+
+    return;
+}
+
+// writes the k smallest elements in order in out, returns how many
+int topKResult(struct topK_t * t, int * out) {
+    memcpy(out,t->heap,sizeof(int)*t->size);
+    introSort(out,t->size);
+
+    return t->size;
+}
+
+void topKFree(struct topK_t * t) {
+    free(t->heap);
+
+    return;
+}
+
+#endif
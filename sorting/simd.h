@@ -0,0 +1,388 @@
+#ifndef H_SORTING_SIMD
+#define H_SORTING_SIMD
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#define SIMD_AVX2 __attribute__((target("avx2")))
+#define SIMD_SSE4 __attribute__((target("sse4.1")))
+#endif
+
+/*
+ * Sorting networks in SIMD registers for up to SIMD_SMALL_DIM ints, and a
+ * vectorized merge, used for the small cases of the other sorts, and a scan
+ * for the first int below a threshold, used by the top-k filter. They are
+ * compiled for AVX2 and SSE4.1 whatever the flags of the build, and the
+ * instruction set is chosen at runtime with CPUID, falling back to scalar
+ * code on other CPUs.
+ *
+ * The network is bitonic: every register is sorted with compare-exchanges
+ * between its own lanes, done as a shuffle, a min, a max and a blend, then
+ * sorted blocks of registers are merged by reversing the second block and
+ * taking the min and max with the first, which leaves two bitonic halves
+ * that are merged first between registers and then inside them.
+ */
+
+#define SIMD_SMALL_DIM 64
+#define SIMD_SCALAR 0
+#define SIMD_SSE41 1
+#define SIMD_AVX2_LEVEL 2
+
+int simdLevel = -1; //set by simdDetect, or by hand to test the fallbacks
+
+int simdDetect(void) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return SIMD_AVX2_LEVEL;
+    if(__builtin_cpu_supports("sse4.1")) return SIMD_SSE41;
+#endif
+    return SIMD_SCALAR;
+}
+
+void scalarSortSmall(int * a, int n) {
+    int i, j, tmp;
+
+    for(i=1;i<n;i++) {
+        tmp = a[i];
+        for(j=i;j>0 && a[j-1]>tmp;j--) a[j] = a[j-1];
+        a[j] = tmp;
+    }
+
+    return;
+}
+
+// the source may be the end of out, since writes never pass reads
+void scalarMerge(int * a, int na, int * b, int nb, int * out) {
+    int i = 0, j = 0, takeRight;
+
+    while(i<na && j<nb) {
+        takeRight = b[j]<a[i];
+        *out++ = takeRight ? b[j] : a[i];
+        j += takeRight;
+        i += 1-takeRight;
+    }
+    memmove(out,&a[i],sizeof(int)*(na-i));
+    memmove(out+na-i,&b[j],sizeof(int)*(nb-j));
+
+    return;
+}
+
+int scalarFindLess(int * a, int n, int threshold) {
+    int i;
+
+    for(i=0;i<n && a[i]>=threshold;i++);
+
+    return i;
+}
+
+#ifdef SIMD_X86
+
+// compare-exchange of every lane with the one given by the shuffle p: lanes
+// in mask take the max
+#define AVX2_STEP(v,p,mask) { \
+    __m256i q_ = (p); \
+    v = _mm256_blend_epi32(_mm256_min_epi32(v,q_),_mm256_max_epi32(v,q_),mask); \
+}
+#define AVX2_SWAP1(v) _mm256_shuffle_epi32(v,_MM_SHUFFLE(2,3,0,1))
+#define AVX2_SWAP2(v) _mm256_shuffle_epi32(v,_MM_SHUFFLE(1,0,3,2))
+#define AVX2_SWAP4(v) _mm256_permute2x128_si256(v,v,0x01)
+
+SIMD_AVX2 static inline __m256i avx2Sort8(__m256i v) {
+    AVX2_STEP(v,AVX2_SWAP1(v),0x66);
+    AVX2_STEP(v,AVX2_SWAP2(v),0x3C);
+    AVX2_STEP(v,AVX2_SWAP1(v),0x5A);
+    AVX2_STEP(v,AVX2_SWAP4(v),0xF0);
+    AVX2_STEP(v,AVX2_SWAP2(v),0xCC);
+    AVX2_STEP(v,AVX2_SWAP1(v),0xAA);
+
+    return v;
+}
+
+// sorts a bitonic register
+SIMD_AVX2 static inline __m256i avx2Merge8(__m256i v) {
+    AVX2_STEP(v,AVX2_SWAP4(v),0xF0);
+    AVX2_STEP(v,AVX2_SWAP2(v),0xCC);
+    AVX2_STEP(v,AVX2_SWAP1(v),0xAA);
+
+    return v;
+}
+
+SIMD_AVX2 static inline __m256i avx2Reverse8(__m256i v) {
+    return _mm256_permutevar8x32_epi32(v,_mm256_setr_epi32(7,6,5,4,3,2,1,0));
+}
+
+// merges the sorted blocks v[0..m) and v[m..2m)
+SIMD_AVX2 static inline void avx2MergeBlocks(__m256i * v, int m) {
+    int i, step, base;
+    __m256i x, y, high[4];
+
+    for(i=0;i<m;i++) {
+        x = v[i];
+        y = avx2Reverse8(v[2*m-1-i]);
+        v[i] = _mm256_min_epi32(x,y);
+        high[i] = _mm256_max_epi32(x,y);
+    }
+    for(i=0;i<m;i++) v[m+i] = high[i];
+
+    for(step=m/2;step>0;step/=2)
+        for(base=0;base<2*m;base+=m)
+            for(i=base;i<base+m;i++) {
+                if(i&step) continue;
+                x = v[i];
+                v[i] = _mm256_min_epi32(x,v[i+step]);
+                v[i+step] = _mm256_max_epi32(x,v[i+step]);
+            }
+
+    for(i=0;i<2*m;i++) v[i] = avx2Merge8(v[i]);
+
+    return;
+}
+
+SIMD_AVX2 void avx2SortSmall(int * a, int n) {
+    int buffer[SIMD_SMALL_DIM], i, r, m;
+    __m256i v[8];
+
+    for(r=1;8*r<n;r*=2);
+
+    memcpy(buffer,a,sizeof(int)*n);
+    for(i=n;i<8*r;i++) buffer[i] = INT_MAX;
+
+    for(i=0;i<r;i++) v[i] = avx2Sort8(_mm256_loadu_si256((__m256i *)&buffer[8*i]));
+    for(m=1;m<r;m*=2)
+        for(i=0;i<r;i+=2*m) avx2MergeBlocks(&v[i],m);
+    for(i=0;i<r;i++) _mm256_storeu_si256((__m256i *)&buffer[8*i],v[i]);
+
+    memcpy(a,buffer,sizeof(int)*n);
+
+    return;
+}
+
+// the 8 smallest of the sorted registers x and y go to x, the others to y
+#define AVX2_MERGE16(x,y) { \
+    __m256i r_ = avx2Reverse8(y); \
+    y = avx2Merge8(_mm256_max_epi32(x,r_)); \
+    x = avx2Merge8(_mm256_min_epi32(x,r_)); \
+}
+
+// a block of 8 from the input with the smaller head is merged with the 8
+// largest elements seen so far, and the 8 smallest of them are written out
+SIMD_AVX2 void avx2Merge(int * a, int na, int * b, int nb, int * out) {
+    int i = 8, j = 8, k = 0;
+    int high[8];
+    __m256i x, y;
+
+    if(na<8 || nb<8) {
+        scalarMerge(a,na,b,nb,out);
+        return;
+    }
+
+    x = _mm256_loadu_si256((__m256i *)a);
+    y = _mm256_loadu_si256((__m256i *)b);
+    while(1) {
+        AVX2_MERGE16(x,y);
+        _mm256_storeu_si256((__m256i *)&out[k],x);
+        k += 8;
+
+        if(i<na && (j>=nb || a[i]<b[j])) {
+            if(i+8>na) break;
+            x = _mm256_loadu_si256((__m256i *)&a[i]);
+            i += 8;
+        }
+        else {
+            if(j>=nb || j+8>nb) break;
+            x = _mm256_loadu_si256((__m256i *)&b[j]);
+            j += 8;
+        }
+    }
+
+    // the 8 left in y, then what is left of b, after what is left of a
+    _mm256_storeu_si256((__m256i *)high,y);
+    scalarMerge(high,8,&a[i],na-i,&out[k+nb-j]);
+    scalarMerge(&out[k+nb-j],8+na-i,&b[j],nb-j,&out[k]);
+
+    return;
+}
+
+#define SSE4_STEP(v,p,mask) { \
+    __m128i q_ = (p); \
+    v = _mm_blend_epi16(_mm_min_epi32(v,q_),_mm_max_epi32(v,q_),mask); \
+}
+#define SSE4_SWAP1(v) _mm_shuffle_epi32(v,_MM_SHUFFLE(2,3,0,1))
+#define SSE4_SWAP2(v) _mm_shuffle_epi32(v,_MM_SHUFFLE(1,0,3,2))
+
+// the masks of _mm_blend_epi16 have two bits per int
+SIMD_SSE4 static inline __m128i sse4Sort4(__m128i v) {
+    SSE4_STEP(v,SSE4_SWAP1(v),0x3C);
+    SSE4_STEP(v,SSE4_SWAP2(v),0xF0);
+    SSE4_STEP(v,SSE4_SWAP1(v),0xCC);
+
+    return v;
+}
+
+SIMD_SSE4 static inline __m128i sse4Merge4(__m128i v) {
+    SSE4_STEP(v,SSE4_SWAP2(v),0xF0);
+    SSE4_STEP(v,SSE4_SWAP1(v),0xCC);
+
+    return v;
+}
+
+SIMD_SSE4 static inline void sse4MergeBlocks(__m128i * v, int m) {
+    int i, step, base;
+    __m128i x, y, high[8];
+
+    for(i=0;i<m;i++) {
+        x = v[i];
+        y = _mm_shuffle_epi32(v[2*m-1-i],_MM_SHUFFLE(0,1,2,3));
+        v[i] = _mm_min_epi32(x,y);
+        high[i] = _mm_max_epi32(x,y);
+    }
+    for(i=0;i<m;i++) v[m+i] = high[i];
+
+    for(step=m/2;step>0;step/=2)
+        for(base=0;base<2*m;base+=m)
+            for(i=base;i<base+m;i++) {
+                if(i&step) continue;
+                x = v[i];
+                v[i] = _mm_min_epi32(x,v[i+step]);
+                v[i+step] = _mm_max_epi32(x,v[i+step]);
+            }
+
+    for(i=0;i<2*m;i++) v[i] = sse4Merge4(v[i]);
+
+    return;
+}
+
+SIMD_SSE4 void sse4SortSmall(int * a, int n) {
+    int buffer[SIMD_SMALL_DIM], i, r, m;
+    __m128i v[16];
+
+    for(r=1;4*r<n;r*=2);
+
+    memcpy(buffer,a,sizeof(int)*n);
+    for(i=n;i<4*r;i++) buffer[i] = INT_MAX;
+
+    for(i=0;i<r;i++) v[i] = sse4Sort4(_mm_loadu_si128((__m128i *)&buffer[4*i]));
+    for(m=1;m<r;m*=2)
+        for(i=0;i<r;i+=2*m) sse4MergeBlocks(&v[i],m);
+    for(i=0;i<r;i++) _mm_storeu_si128((__m128i *)&buffer[4*i],v[i]);
+
+    memcpy(a,buffer,sizeof(int)*n);
+
+    return;
+}
+
+// 32 elements per step, with the four comparisons or-ed before the branch
+SIMD_AVX2 int avx2FindLess(int * a, int n, int threshold) {
+    __m256i t = _mm256_set1_epi32(threshold), any;
+    int i;
+
+    for(i=0;i+32<=n;i+=32) {
+        any = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpgt_epi32(t,_mm256_loadu_si256((__m256i *)&a[i])),
+                    _mm256_cmpgt_epi32(t,_mm256_loadu_si256((__m256i *)&a[i+8]))),
+                _mm256_or_si256(_mm256_cmpgt_epi32(t,_mm256_loadu_si256((__m256i *)&a[i+16])),
+                    _mm256_cmpgt_epi32(t,_mm256_loadu_si256((__m256i *)&a[i+24]))));
+        if(!_mm256_testz_si256(any,any)) break;
+    }
+
+    return i+scalarFindLess(&a[i],n-i,threshold);
+}
+
+SIMD_SSE4 int sse4FindLess(int * a, int n, int threshold) {
+    __m128i t = _mm_set1_epi32(threshold), any;
+    int i;
+
+    for(i=0;i+16<=n;i+=16) {
+        any = _mm_or_si128(
+                _mm_or_si128(_mm_cmplt_epi32(_mm_loadu_si128((__m128i *)&a[i]),t),
+                    _mm_cmplt_epi32(_mm_loadu_si128((__m128i *)&a[i+4]),t)),
+                _mm_or_si128(_mm_cmplt_epi32(_mm_loadu_si128((__m128i *)&a[i+8]),t),
+                    _mm_cmplt_epi32(_mm_loadu_si128((__m128i *)&a[i+12]),t)));
+        if(!_mm_testz_si128(any,any)) break;
+    }
+
+    return i+scalarFindLess(&a[i],n-i,threshold);
+}
+
+#endif
+
+// sorts up to SIMD_SMALL_DIM ints
+void simdSortSmall(int * a, int n) {
+    if(simdLevel<0) simdLevel = simdDetect();
+
+#ifdef SIMD_X86
+    if(simdLevel==SIMD_AVX2_LEVEL) avx2SortSmall(a,n);
+    else if(simdLevel==SIMD_SSE41) sse4SortSmall(a,n);
+    else
+#endif
+    scalarSortSmall(a,n);
+
+    return;
+}
+
+// merges the sorted a[0..na) and b[0..nb) in out, which must not overlap them
+void simdMerge(int * a, int na, int * b, int nb, int * out) {
+    if(simdLevel<0) simdLevel = simdDetect();
+
+#ifdef SIMD_X86
+    if(simdLevel==SIMD_AVX2_LEVEL) avx2Merge(a,na,b,nb,out);
+    else
+#endif
+    scalarMerge(a,na,b,nb,out);
+
+    return;
+}
+
+// index of the first element of a[0..n) less than threshold, n if none
+int simdFindLess(int * a, int n, int threshold) {
+    if(simdLevel<0) simdLevel = simdDetect();
+
+#ifdef SIMD_X86
+    if(simdLevel==SIMD_AVX2_LEVEL) return avx2FindLess(a,n,threshold);
+    if(simdLevel==SIMD_SSE41) return sse4FindLess(a,n,threshold);
+#endif
+    return scalarFindLess(a,n,threshold);
+}
+
+/*
+ * SIMD Sort sorts blocks of SIMD_SMALL_DIM with the sorting network, then
+ * merges them bottom-up with the vectorized merge:
+ * - Time complexity: $O(n\log(n))$
+ * - Space complexity: $O(n)$
+ * - Stability: No
+ * - Optimizations: the passes alternate the array and one buffer
+ */
+
+void simdSort(int * a, int n) {
+    int * b, * src, * dst, * swp;
+    long i, width;
+
+    for(i=0;i<n;i+=SIMD_SMALL_DIM)
+        simdSortSmall(&a[i],n-i<SIMD_SMALL_DIM ? n-i : SIMD_SMALL_DIM);
+    if(n<=SIMD_SMALL_DIM) return;
+
+    b = malloc(sizeof(int)*n);
+    src = a;
+    dst = b;
+    for(width=SIMD_SMALL_DIM;width<n;width*=2) {
+        for(i=0;i<n;i+=2*width) {
+            if(n-i<=width) memcpy(&dst[i],&src[i],sizeof(int)*(n-i));
+            else simdMerge(&src[i],width,&src[i+width],
+                    n-i-width<width ? n-i-width : width,&dst[i]);
+        }
+        swp = src;
+        src = dst;
+        dst = swp;
+    }
+
+    if(src!=a) memcpy(a,src,sizeof(int)*n);
+    free(b);
+
+    return;
+}
+
+#endif
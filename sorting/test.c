@@ -4,10 +4,22 @@
 #include <string.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <unistd.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 
 #include "common.h"
 #include "algo.h"
+#include "parallel.h"
+#include "external.h"
+#include "generic.h"
+#include "adaptive.h"
+#include "mapped.h"
+#include "verify.h"
+#include "multiway.h"
+#ifdef PERF_COUNTERS
+#include "perfcount.h"
+#endif
 
 struct testAlgoArg_t {
     char * algoName;
@@ -17,18 +29,54 @@ struct testAlgoArg_t {
 
 pthread_mutex_t print;
 
-void printOrder(int * a, int n) {
-    if(checkOrder(a,n))
+struct pool_t * pool;
+
+struct multiset_t input; //hash of the elements of the input
+
+// the output checked against the input, not holding the print lock, since
+// the pool can be busy with a sort of another thread
+struct verifyOutput_t {
+    int inOrder;
+    int sameElements;
+};
+
+void verifyOutput(int * a, int n, struct verifyOutput_t * v) {
+    struct multiset_t output;
+
+    v->inOrder = parallelVerify(pool,a,n,&output);
+    v->sameElements = multisetEqual(&output,&input);
+
+    return;
+}
+
+void printOrder(struct verifyOutput_t * v) {
+    if(v->inOrder)
         printf("The array is in order.\n");
     else
         printf("The array is not in order.\n");
+    if(!v->sameElements)
+        printf("Error: the array lost or duplicated elements of the input.\n");
 
     return;
 }
 
+double elapsed(struct timespec * start) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC,&end);
+
+    return (end.tv_sec-start->tv_sec)+(end.tv_nsec-start->tv_nsec)*1e-9;
+}
+
 void * testAlgo(void * arg) {
 
     struct rusage threadRes;
+    struct verifyOutput_t verified;
+    // the parallel sorts run on the pool workers, so RUSAGE_THREAD leaves
+    // their CPU time out: they are timed on the wall clock instead
+    struct timespec start;
+    double wallTime;
+    int parallel = 0;
 
     char * algoName = ((struct testAlgoArg_t *)arg)->algoName;
     int * a = ((struct testAlgoArg_t *)arg)->array;
@@ -38,7 +86,18 @@ void * testAlgo(void * arg) {
 
     testArray = malloc(sizeof(int)*n);
 
-    copyArray(a,testArray,n);
+    parallelCopy(pool,a,testArray,n);
+
+#ifdef PERF_COUNTERS
+    // counters of this thread only, not of the pool workers
+    struct perfRegion_t region;
+    struct perfSample_t sample;
+
+    perfRegionInit(&region,algoName);
+    perfBegin(&sample);
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC,&start);
 
     if(strcmp(algoName,"bubble") == 0) {
         printf("Testing Bubble Sort\n");
@@ -52,6 +111,18 @@ void * testAlgo(void * arg) {
         printf("Testing Merge Sort\n");
         mergeSort(testArray,n);
     }
+    else if(strcmp(algoName,"merge-natural") == 0) {
+        printf("Testing Natural Merge Sort\n");
+        naturalMergeSort(testArray,n);
+    }
+    else if(strcmp(algoName,"merge-multiway") == 0) {
+        printf("Testing Multiway Merge Sort\n");
+        multiwayMergeSort(testArray,n);
+    }
+    else if(strcmp(algoName,"block-merge") == 0) {
+        printf("Testing Block Merge Sort\n");
+        blockMergeSort(testArray,n);
+    }
     else if(strcmp(algoName,"quick") == 0) {
         printf("Testing Quick Sort\n");
         quickSort(testArray,n);
@@ -60,6 +131,26 @@ void * testAlgo(void * arg) {
         printf("Testing Quick Sort Glibc\n");
         qsort(testArray,n,sizeof(int),cmpintasc);
     }
+    else if(strcmp(algoName,"heap") == 0) {
+        printf("Testing Heap Sort\n");
+        heapSort(testArray,n);
+    }
+    else if(strcmp(algoName,"intro") == 0) {
+        printf("Testing Intro Sort\n");
+        introSort(testArray,n);
+    }
+    else if(strcmp(algoName,"pdq") == 0) {
+        printf("Testing Pattern-defeating Quick Sort\n");
+        pdqSort(testArray,n);
+    }
+    else if(strcmp(algoName,"simd") == 0) {
+        printf("Testing SIMD Sort\n");
+        simdSort(testArray,n);
+    }
+    else if(strcmp(algoName,"adaptive") == 0) {
+        printf("Testing Adaptive Sort\n");
+        printf("Adaptive Sort chose %s\n", sortChoiceNames[sort(testArray,n)]);
+    }
     else if(strcmp(algoName,"count") == 0) {
         if(MAX_RAND>8192) printf("Domain is too big to use counting sort.\n");
         else {
@@ -74,13 +165,53 @@ void * testAlgo(void * arg) {
             countingStableSort(testArray,n, MAX_RAND);
         }
     }
+    else if(strcmp(algoName,"radix") == 0) {
+        printf("Testing Radix Sort\n");
+        radixSort(testArray,n);
+    }
+    else if(strcmp(algoName,"american-flag") == 0) {
+        printf("Testing American Flag Sort\n");
+        americanFlagSort(testArray,n);
+    }
+    else if(strcmp(algoName,"merge-parallel") == 0) {
+        printf("Testing Parallel Merge Sort\n");
+        parallelMergeSort(pool,testArray,n);
+        parallel = 1;
+    }
+    else if(strcmp(algoName,"sample-parallel") == 0) {
+        printf("Testing Parallel Sample Sort\n");
+        parallelSampleSort(pool,testArray,n);
+        parallel = 1;
+    }
+    else if(strcmp(algoName,"count-parallel") == 0) {
+        printf("Testing Parallel Counting Sort\n");
+        parallelCountingSort(pool,testArray,n);
+        parallel = 1;
+    }
+    else if(strcmp(algoName,"count-stable-parallel") == 0) {
+        printf("Testing Parallel Counting Stable Sort\n");
+        parallelCountingStableSort(pool,testArray,n);
+        parallel = 1;
+    }
     else {
         printf("Error: there is no algorithm with such name\n");
+#ifdef PERF_COUNTERS
+        perfClose();
+#endif
         return NULL;
     }
 
+    wallTime = elapsed(&start);
+
+#ifdef PERF_COUNTERS
+    perfEnd(&region,&sample);
+    perfClose();
+#endif
+
     getrusage(RUSAGE_THREAD, &threadRes);
 
+    verifyOutput(testArray,n,&verified);
+
     pthread_mutex_lock(&print);
     if(n<=PRINT_THRESHOLD){
         printf("[%s]\n", algoName);
@@ -88,8 +219,14 @@ void * testAlgo(void * arg) {
     }
     
     printf("[%s] ", algoName);
-    printOrder(testArray,n);
+    printOrder(&verified);
+    if(parallel)
+        printf("Wall time, pool workers included: %.6fs\n"
+                "(the CPU times below are of this thread only)\n", wallTime);
     printResources(&threadRes);
+#ifdef PERF_COUNTERS
+    perfPrint(&region,stdout);
+#endif
     pthread_mutex_unlock(&print);
 
     free(testArray);
@@ -97,17 +234,272 @@ void * testAlgo(void * arg) {
     return NULL;
 }
 
+// reads a binary file of keys and checks that they are in order
+int fileInOrder(char * path, int keySize) {
+    struct runReader_t reader;
+    struct ioThread_t io;
+    struct stat st;
+    int64_t key, prev = INT64_MIN;
+    int fd, inOrder = 1;
+
+    fd = open(path,O_RDONLY);
+    fstat(fd,&st);
+    ioStart(&io);
+    readerOpen(&reader,&io,fd,0,st.st_size,EXTERNAL_IO_MAX,keySize);
+    while(readerNext(&reader,&key)) {
+        if(key<prev) inOrder = 0;
+        prev = key;
+    }
+    readerClose(&reader);
+    ioStop(&io);
+    close(fd);
+
+    return inOrder;
+}
+
+// external sort of a file, then check that the output is in order
+int testExternal(char * input, char * output, int keyBits, int memoryMB) {
+    struct rusage res;
+
+    printf("Testing External Merge Sort\n");
+    if(externalSort(input,output,keyBits/8,(size_t)memoryMB<<20)) return 1;
+
+    getrusage(RUSAGE_SELF, &res);
+
+    printf("[external] ");
+    if(fileInOrder(output,keyBits/8)) printf("The file is in order.\n");
+    else printf("The file is not in order.\n");
+    printResources(&res);
+
+    return 0;
+}
+
+uint64_t genericSeed = 88172645463325252ull;
+
+uint64_t randomBits(void) {
+    genericSeed ^= genericSeed<<13;
+    genericSeed ^= genericSeed>>7;
+    genericSeed ^= genericSeed<<17;
+
+    return genericSeed;
+}
+
+// sort of a file where it is, through a mapping, then check its order
+int testMapped(char * path, int keyBits, char * mode, int huge) {
+    struct timespec start;
+    struct rusage res;
+    int flags = huge ? MAPPED_HUGE : 0;
+
+    if(strcmp(mode,"scratch") == 0) flags |= MAPPED_SCRATCH;
+    else if(strcmp(mode,"inplace") != 0) {
+        printf("The mode must be inplace or scratch.\n");
+        return 1;
+    }
+
+    printf("Testing Mapped Sort\n");
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    if(mappedSort(path,keyBits/8,flags)) return 1;
+    printf("[mmap] %s%s: %.3f s\n",mode,huge ? " huge" : "",elapsed(&start));
+
+    getrusage(RUSAGE_SELF, &res);
+
+    printf("[mmap] ");
+    if(fileInOrder(path,keyBits/8)) printf("The file is in order.\n");
+    else printf("The file is not in order.\n");
+    printResources(&res);
+
+    return 0;
+}
+
+// times qsort, which calls compareName through a pointer, against the
+// sorts with the comparison inlined, on the same random array
+#define TEST_GENERIC(Name, type, RANDOM) \
+void testGeneric##Name(long n) { \
+    type * a = malloc(sizeof(type)*n); \
+    type * b = malloc(sizeof(type)*n); \
+    void (* sorts[])(type *, long) = {introSort##Name,mergeSort##Name,heapSort##Name}; \
+    char * names[] = {"intro","merge","heap"}; \
+    struct timespec start; \
+    double qsortTime, time; \
+    long i; \
+    int s, inOrder; \
+\
+    for(i=0;i<n;i++) a[i] = RANDOM; \
+\
+    memcpy(b,a,sizeof(type)*n); \
+    clock_gettime(CLOCK_MONOTONIC,&start); \
+    qsort(b,n,sizeof(type),compare##Name); \
+    qsortTime = elapsed(&start); \
+    printf("[%s] qsort: %.3fs\n",#Name,qsortTime); \
+\
+    for(s=0;s<3;s++) { \
+        memcpy(b,a,sizeof(type)*n); \
+        clock_gettime(CLOCK_MONOTONIC,&start); \
+        sorts[s](b,n); \
+        time = elapsed(&start); \
+        for(i=1,inOrder=1;i<n;i++) inOrder &= compare##Name(&b[i-1],&b[i])<=0; \
+        printf("[%s] %s: %.3fs, speedup over qsort %.2fx, %s\n",#Name,names[s],time, \
+                qsortTime/time,inOrder ? "in order" : "NOT in order"); \
+    } \
+    printf("\n"); \
+\
+    free(a); \
+    free(b); \
+\
+    return; \
+}
+
+TEST_GENERIC(Int32, int32_t, (int32_t)randomBits())
+TEST_GENERIC(Uint32, uint32_t, (uint32_t)randomBits())
+TEST_GENERIC(Int64, int64_t, (int64_t)randomBits())
+TEST_GENERIC(Uint64, uint64_t, randomBits())
+TEST_GENERIC(Float, float, (float)(int32_t)randomBits()/65536)
+TEST_GENERIC(Double, double, (double)(int64_t)randomBits()/65536)
+TEST_GENERIC(Record, struct record_t, ((struct record_t){(int64_t)randomBits(),i}))
+
+void testGeneric(long n) {
+    printf("Testing Type Generic Sorts against qsort\n");
+
+    testGenericInt32(n);
+    testGenericUint32(n);
+    testGenericInt64(n);
+    testGenericUint64(n);
+    testGenericFloat(n);
+    testGenericDouble(n);
+    testGenericRecord(n);
+
+    return;
+}
+
+void stableCounting(int * a, int n) { countingStableSort(a,n,MAX_RAND); }
+
+// the stable sorts on the same random array, each in a process of its own,
+// so that the maximum resident set size is only the one of that sort
+int testStable(int n) {
+    char * names[] = {"merge","merge-natural","block-merge","count-stable"};
+    void (* sorts[])(int *, int) = {mergeSort,naturalMergeSort,blockMergeSort,stableCounting};
+    struct multiset_t input, output;
+    struct timespec start;
+    struct rusage res;
+    double time;
+    long inputRss;
+    int s, i, inOrder, * a;
+    pid_t pid;
+
+    printf("Testing the stable sorts on %d elements\n", n);
+
+    for(s=0;s<4;s++) {
+        fflush(stdout);
+        if((pid = fork())==0) {
+            a = malloc(sizeof(int)*n);
+            for(i=0;i<n;i++) a[i] = ((randomAt(genericSeed,i)>>32)*MAX_RAND)>>32;
+            memset(&input,0,sizeof(input));
+            simdVerify(a,n,0,&input);
+
+            getrusage(RUSAGE_SELF, &res);
+            inputRss = res.ru_maxrss;
+            clock_gettime(CLOCK_MONOTONIC,&start);
+            sorts[s](a,n);
+            time = elapsed(&start);
+            getrusage(RUSAGE_SELF, &res);
+
+            memset(&output,0,sizeof(output));
+            inOrder = simdVerify(a,n,n-1,&output) && multisetEqual(&input,&output);
+            printf("[%s] %.3fs, %.1f million elements per second, %ldkB more than the input\n",
+                    names[s], time, n/time*1e-6, res.ru_maxrss-inputRss);
+            printf("[%s] ", names[s]);
+            if(inOrder) printf("The array is in order.\n");
+            else printf("The array is not in order.\n");
+            printResources(&res);
+            exit(0);
+        }
+        waitpid(pid,NULL,0);
+    }
+
+    return 0;
+}
+
+// times the algorithms of sort() on this machine and saves the thresholds
+int testTune(char * path) {
+    struct sortConfig_t config;
+
+    printf("Tuning Adaptive Sort\n");
+    sortTune(&config);
+
+    printf("insertion_max %d\n"
+            "counting_ratio %g\n"
+            "runs_max %g\n"
+            "duplicates_min %g\n"
+            "radix_min %d\n",
+            config.insertionMax,config.countingRatio,config.runsMax,
+            config.duplicatesMin,config.radixMin);
+
+    if(!sortSaveConfig(path,&config)) {
+        perror(path);
+        return 1;
+    }
+    printf("Saved in %s\n", path);
+
+    return 0;
+}
+
 int main(int argc, char * argv[]) {
 
+    if(argc==6 && strcmp(argv[1],"external") == 0)
+        return testExternal(argv[2],argv[3],atoi(argv[4]),atoi(argv[5]));
+
+    if((argc==5 || argc==6) && strcmp(argv[1],"mmap") == 0)
+        return testMapped(argv[2],atoi(argv[3]),argv[4],argc==6 && strcmp(argv[5],"huge") == 0);
+
+    if(argc==3 && strcmp(argv[1],"generic") == 0) {
+        testGeneric(atol(argv[2]));
+        return 0;
+    }
+
+    if(argc<=3 && argc>1 && strcmp(argv[1],"tune") == 0)
+        return testTune(argc==3 ? argv[2] : ADAPTIVE_CONFIG);
+
+    if(argc==3 && strcmp(argv[1],"stable") == 0)
+        return testStable(atoi(argv[2]));
+
     if(argc==1) {
         printf("Please select at least one algorithm:\n"
                 "bubble\n"
                 "insert\n"
                 "merge\n"
+                "merge-natural\n"
+                "merge-multiway\n"
+                "block-merge\n"
                 "quick\n"
                 "quick-glibc\n"
+                "heap\n"
+                "intro\n"
+                "pdq\n"
+                "simd\n"
+                "adaptive\n"
                 "count\n"
                 "count-stable\n"
+                "radix\n"
+                "american-flag\n"
+                "merge-parallel\n"
+                "sample-parallel\n"
+                "count-parallel\n"
+                "count-stable-parallel\n"
+                "\n"
+                "or sort a binary file of 32 or 64 bit keys with a memory budget:\n"
+                "external <input> <output> <32|64> <memory MB>\n"
+                "\n"
+                "or sort it where it is, through a mapping, with huge pages if asked:\n"
+                "mmap <file> <32|64> <inplace|scratch> [huge]\n"
+                "\n"
+                "or time the type generic sorts against qsort:\n"
+                "generic <size>\n"
+                "\n"
+                "or calibrate adaptive on this machine, in sort.conf by default:\n"
+                "tune [config file]\n"
+                "\n"
+                "or compare time and memory of the stable sorts:\n"
+                "stable <size>\n"
                 "\n");
         return 0;
     }
@@ -118,10 +510,16 @@ int main(int argc, char * argv[]) {
     scanf("%d", &size);
 
     int * a;
+    uint64_t seed = getenv("SORT_SEED") ? strtoull(getenv("SORT_SEED"),NULL,0) : (uint64_t)time(NULL);
 
     a = malloc(sizeof(int)*size);
 
-    initializeArray(a,size);
+    pool = poolCreate(sysconf(_SC_NPROCESSORS_ONLN));
+
+    // the same array for the same SORT_SEED
+    printf("Seed: %llu\n", (unsigned long long)seed);
+    parallelGenerate(pool,a,size,seed,MAX_RAND);
+    parallelVerify(pool,a,size,&input);
     
     if(size<=PRINT_THRESHOLD){
         printArray(a,size);  
@@ -147,6 +545,8 @@ int main(int argc, char * argv[]) {
         pthread_join(tID[i],NULL);
     }
 
+    poolDestroy(pool);
+
     free(a);
 
     return 0;
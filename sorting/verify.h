@@ -0,0 +1,274 @@
+#ifndef H_SORTING_VERIFY
+#define H_SORTING_VERIFY
+
+#include <stdint.h>
+#include <string.h>
+#include "pool.h"
+#include "simd.h"
+
+/*
+ * Input generation and output verification for large arrays, in parallel
+ * with the pool, so that the tests do not spend more time around a sort
+ * than in it.
+ * The generator is counter based: element i is splitmix64 of seed+i, so
+ * every block is filled on its own and the array depends only on the
+ * seed, whatever the number of threads.
+ * The verifier checks that the array is in order and computes a multiset
+ * hash of it, the sum of a hash of every element, which does not depend on
+ * the order; comparing it with the hash of the input finds a sort that
+ * loses or duplicates elements, which a check of the order alone cannot.
+ * The element hash is the murmur3 finalizer, a bijection on 32 bits, so a
+ * single element overwritten by another always changes the sum; there are
+ * two of them with different keys, summed on 64 bits. Both the hash and the
+ * order check are vectorized with AVX2 or SSE4.1, chosen as in simd.h.
+ */
+
+#define VERIFY_BLOCKS_PER_THREAD 4
+#define VERIFY_GAMMA 0x9E3779B97F4A7C15ull
+#define VERIFY_KEY1 0x9E3779B9u
+#define VERIFY_KEY2 0x7F4A7C15u
+
+struct multiset_t {
+    uint64_t hash[2];
+    long n;
+};
+
+uint64_t randomAt(uint64_t seed, long i) {
+    uint64_t z = seed+(uint64_t)(i+1)*VERIFY_GAMMA;
+
+    z = (z^(z>>30))*0xBF58476D1CE4E5B9ull;
+    z = (z^(z>>27))*0x94D049BB133111EBull;
+
+    return z^(z>>31);
+}
+
+static inline uint32_t verifyMix(uint32_t x) {
+    x ^= x>>16;
+    x *= 0x85EBCA6Bu;
+    x ^= x>>13;
+    x *= 0xC2B2AE35u;
+
+    return x^(x>>16);
+}
+
+// adds the hash of a[0..n) to m, and returns 0 if a pair of a[0..pairs]
+// is out of order, where pairs is n-1, or n if a[n] can be read
+int scalarVerify(const int * a, long n, long pairs, struct multiset_t * m) {
+    long i;
+    int inOrder = 1;
+
+    for(i=0;i<n;i++) {
+        m->hash[0] += verifyMix((uint32_t)a[i]^VERIFY_KEY1);
+        m->hash[1] += verifyMix((uint32_t)a[i]^VERIFY_KEY2);
+    }
+    for(i=0;i<pairs;i++) inOrder &= a[i]<=a[i+1];
+    m->n += n;
+
+    return inOrder;
+}
+
+#ifdef SIMD_X86
+
+#define VERIFY_MIX(set1,xor,srli,mullo,x) { \
+    x = xor(x,srli(x,16)); \
+    x = mullo(x,set1((int)0x85EBCA6Bu)); \
+    x = xor(x,srli(x,13)); \
+    x = mullo(x,set1((int)0xC2B2AE35u)); \
+    x = xor(x,srli(x,16)); \
+}
+
+SIMD_AVX2 int avx2Verify(const int * a, long n, long pairs, struct multiset_t * m) {
+    __m256i x, h1, h2, sum1 = _mm256_setzero_si256(), sum2 = _mm256_setzero_si256();
+    __m256i bad = _mm256_setzero_si256(), low = _mm256_set1_epi64x(0xFFFFFFFF);
+    __m256i key1 = _mm256_set1_epi32((int)VERIFY_KEY1), key2 = _mm256_set1_epi32((int)VERIFY_KEY2);
+    uint64_t lanes[4];
+    long i;
+    int j;
+
+    for(i=0;i+8<=pairs;i+=8) {
+        x = _mm256_loadu_si256((__m256i *)&a[i]);
+        bad = _mm256_or_si256(bad,_mm256_cmpgt_epi32(x,_mm256_loadu_si256((__m256i *)&a[i+1])));
+        h1 = _mm256_xor_si256(x,key1);
+        h2 = _mm256_xor_si256(x,key2);
+        VERIFY_MIX(_mm256_set1_epi32,_mm256_xor_si256,_mm256_srli_epi32,_mm256_mullo_epi32,h1);
+        VERIFY_MIX(_mm256_set1_epi32,_mm256_xor_si256,_mm256_srli_epi32,_mm256_mullo_epi32,h2);
+        // the two halves of every 64 bit lane, so that the sums do not wrap
+        sum1 = _mm256_add_epi64(sum1,_mm256_add_epi64(_mm256_and_si256(h1,low),_mm256_srli_epi64(h1,32)));
+        sum2 = _mm256_add_epi64(sum2,_mm256_add_epi64(_mm256_and_si256(h2,low),_mm256_srli_epi64(h2,32)));
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes,sum1);
+    for(j=0;j<4;j++) m->hash[0] += lanes[j];
+    _mm256_storeu_si256((__m256i *)lanes,sum2);
+    for(j=0;j<4;j++) m->hash[1] += lanes[j];
+    m->n += i;
+
+    return _mm256_testz_si256(bad,bad) & scalarVerify(&a[i],n-i,pairs-i,m);
+}
+
+SIMD_SSE4 int sse4Verify(const int * a, long n, long pairs, struct multiset_t * m) {
+    __m128i x, h1, h2, sum1 = _mm_setzero_si128(), sum2 = _mm_setzero_si128();
+    __m128i bad = _mm_setzero_si128(), low = _mm_set1_epi64x(0xFFFFFFFF);
+    __m128i key1 = _mm_set1_epi32((int)VERIFY_KEY1), key2 = _mm_set1_epi32((int)VERIFY_KEY2);
+    uint64_t lanes[2];
+    long i;
+
+    for(i=0;i+4<=pairs;i+=4) {
+        x = _mm_loadu_si128((__m128i *)&a[i]);
+        bad = _mm_or_si128(bad,_mm_cmpgt_epi32(x,_mm_loadu_si128((__m128i *)&a[i+1])));
+        h1 = _mm_xor_si128(x,key1);
+        h2 = _mm_xor_si128(x,key2);
+        VERIFY_MIX(_mm_set1_epi32,_mm_xor_si128,_mm_srli_epi32,_mm_mullo_epi32,h1);
+        VERIFY_MIX(_mm_set1_epi32,_mm_xor_si128,_mm_srli_epi32,_mm_mullo_epi32,h2);
+        sum1 = _mm_add_epi64(sum1,_mm_add_epi64(_mm_and_si128(h1,low),_mm_srli_epi64(h1,32)));
+        sum2 = _mm_add_epi64(sum2,_mm_add_epi64(_mm_and_si128(h2,low),_mm_srli_epi64(h2,32)));
+    }
+
+    _mm_storeu_si128((__m128i *)lanes,sum1);
+    m->hash[0] += lanes[0]+lanes[1];
+    _mm_storeu_si128((__m128i *)lanes,sum2);
+    m->hash[1] += lanes[0]+lanes[1];
+    m->n += i;
+
+    return _mm_testz_si128(bad,bad) & scalarVerify(&a[i],n-i,pairs-i,m);
+}
+
+#endif
+
+int simdVerify(const int * a, long n, long pairs, struct multiset_t * m) {
+    if(simdLevel<0) simdLevel = simdDetect();
+
+#ifdef SIMD_X86
+    if(simdLevel==SIMD_AVX2_LEVEL) return avx2Verify(a,n,pairs,m);
+    if(simdLevel==SIMD_SSE41) return sse4Verify(a,n,pairs,m);
+#endif
+    return scalarVerify(a,n,pairs,m);
+}
+
+struct verify_t {
+    int * a;
+    const int * src; //of the copy
+    long n;
+    int blocks;
+    uint64_t seed; //of the generator
+    uint32_t max;
+    int * inOrder; //of every block
+    struct multiset_t * multiset;
+};
+
+struct verifyTask_t {
+    struct verify_t * v;
+    int index;
+};
+
+void verifyGenerateTask(void * arg) {
+    struct verify_t * v = ((struct verifyTask_t *)arg)->v;
+    int block = ((struct verifyTask_t *)arg)->index;
+    long i, lo = v->n*block/v->blocks, hi = v->n*(block+1)/v->blocks;
+
+    // the high half of the random bits times max, which is uniform enough
+    // and has no division
+    for(i=lo;i<hi;i++) v->a[i] = ((randomAt(v->seed,i)>>32)*v->max)>>32;
+
+    return;
+}
+
+void verifyCopyTask(void * arg) {
+    struct verify_t * v = ((struct verifyTask_t *)arg)->v;
+    int block = ((struct verifyTask_t *)arg)->index;
+    long lo = v->n*block/v->blocks, hi = v->n*(block+1)/v->blocks;
+
+    memcpy(&v->a[lo],&v->src[lo],sizeof(int)*(hi-lo));
+
+    return;
+}
+
+void verifyBlockTask(void * arg) {
+    struct verify_t * v = ((struct verifyTask_t *)arg)->v;
+    int block = ((struct verifyTask_t *)arg)->index;
+    long lo = v->n*block/v->blocks, hi = v->n*(block+1)/v->blocks;
+
+    // every block also checks its last element against the next block
+    v->inOrder[block] = simdVerify(&v->a[lo],hi-lo,(hi<v->n ? hi : hi-1)-lo,&v->multiset[block]);
+
+    return;
+}
+
+struct verifyRun_t {
+    struct verify_t * v;
+    void (* run)(void *);
+};
+
+void verifyRunTask(void * arg) {
+    struct verify_t * v = ((struct verifyRun_t *)arg)->v;
+    struct verifyTask_t * tasks = malloc(sizeof(struct verifyTask_t)*v->blocks);
+    int i;
+
+    for(i=0;i<v->blocks;i++) {
+        tasks[i].v = v;
+        tasks[i].index = i;
+    }
+    poolFor(((struct verifyRun_t *)arg)->run,tasks,sizeof(struct verifyTask_t),v->blocks);
+
+    free(tasks);
+
+    return;
+}
+
+void verifyRun(struct pool_t * pool, struct verify_t * v, void (* run)(void *)) {
+    struct verifyRun_t r = {v,run};
+
+    v->blocks = pool->threads*VERIFY_BLOCKS_PER_THREAD;
+    if(v->n<(long)v->blocks*SIMD_SMALL_DIM) v->blocks = 1;
+
+    poolRun(pool,&verifyRunTask,&r);
+
+    return;
+}
+
+// fills a with n values in [0,max), which depend only on the seed
+void parallelGenerate(struct pool_t * pool, int * a, long n, uint64_t seed, uint32_t max) {
+    struct verify_t v = {.a = a, .n = n, .seed = seed, .max = max};
+
+    verifyRun(pool,&v,&verifyGenerateTask);
+
+    return;
+}
+
+void parallelCopy(struct pool_t * pool, const int * src, int * dst, long n) {
+    struct verify_t v = {.a = dst, .src = src, .n = n};
+
+    verifyRun(pool,&v,&verifyCopyTask);
+
+    return;
+}
+
+// returns 1 if a is in order, and its multiset hash in m
+int parallelVerify(struct pool_t * pool, int * a, long n, struct multiset_t * m) {
+    struct verify_t v = {.a = a, .n = n};
+    int i, inOrder = 1;
+
+    v.inOrder = malloc(sizeof(int)*pool->threads*VERIFY_BLOCKS_PER_THREAD);
+    v.multiset = calloc(pool->threads*VERIFY_BLOCKS_PER_THREAD,sizeof(struct multiset_t));
+
+    verifyRun(pool,&v,&verifyBlockTask);
+
+    memset(m,0,sizeof(*m));
+    for(i=0;i<v.blocks;i++) {
+        inOrder &= v.inOrder[i];
+        m->hash[0] += v.multiset[i].hash[0];
+        m->hash[1] += v.multiset[i].hash[1];
+        m->n += v.multiset[i].n;
+    }
+
+    free(v.inOrder);
+    free(v.multiset);
+
+    return inOrder;
+}
+
+int multisetEqual(struct multiset_t * m1, struct multiset_t * m2) {
+    return m1->n==m2->n && m1->hash[0]==m2->hash[0] && m1->hash[1]==m2->hash[1];
+}
+
+#endif